@@ -0,0 +1,76 @@
+#include "outputchain.h"
+#include <algorithm>
+
+void OutputChain::Append(const char *data, size_t len, std::shared_ptr<const void> owner, bool mapped)
+{
+    if (len == 0)
+    {
+        return;
+    }
+    bytes_ += len;
+    if (slices_.size() > head_)
+    {
+        OutputSlice &last = slices_.back();
+        if (last.data + last.len == data && last.owner == owner && last.mapped == mapped)
+        {
+            last.len += len;
+            return;
+        }
+    }
+    slices_.push_back(OutputSlice{data, len, mapped, std::move(owner)});
+}
+
+ssize_t OutputChain::WriteFd(int fd, size_t limit)
+{
+    struct iovec iov[MAX_IOV];
+    int count = 0;
+    size_t total = 0;
+    for (size_t i = head_; i < slices_.size() && count < MAX_IOV && total < limit; ++i)
+    {
+        iov[count].iov_base = (void *)slices_[i].data;
+        iov[count].iov_len = std::min(slices_[i].len, limit - total);
+        total += iov[count].iov_len;
+        count++;
+    }
+    ssize_t n = writev(fd, iov, count);
+    if (n > 0)
+    {
+        Consume_(n);
+    }
+    return n;
+}
+
+// 跳过已经发送完的片段并释放它们的引用，调整部分发送的片段的起始位置
+void OutputChain::Consume_(size_t n)
+{
+    bytes_ -= n;
+    while (n > 0 && n >= slices_[head_].len)
+    {
+        n -= slices_[head_].len;
+        slices_[head_].owner.reset();
+        head_++;
+    }
+    if (n > 0)
+    {
+        slices_[head_].data += n;
+        slices_[head_].len -= n;
+    }
+    if (head_ == slices_.size())
+    {
+        Clear();
+    }
+}
+
+void OutputChain::Clear()
+{
+    slices_.clear();
+    head_ = 0;
+    bytes_ = 0;
+}
+
+void OutputChain::Reset()
+{
+    std::vector<OutputSlice>().swap(slices_);
+    head_ = 0;
+    bytes_ = 0;
+}
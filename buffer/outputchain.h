@@ -0,0 +1,71 @@
+// 响应的输出链：按顺序排列的一组数据片段，一次writev发送最多IOV_MAX个片段
+// 片段直接引用响应头缓冲区、常量、缓存的响应、文件映射等，不做拷贝；
+// 引用共享数据（缓存项、压缩结果）时片段持有它的引用计数，发送完成前数据不会被释放
+
+#ifndef OUTPUTCHAIN_H
+#define OUTPUTCHAIN_H
+
+#include <limits.h>
+#include <algorithm>
+#include <sys/uio.h>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+struct OutputSlice
+{
+    const char *data;
+    size_t len;
+    bool mapped; // 数据在文件映射中，发送前可能需要从磁盘读入
+    std::shared_ptr<const void> owner; // 持有数据所在的对象，常量和连接自己的缓冲区为空
+};
+
+class OutputChain
+{
+public:
+    OutputChain() : head_(0), bytes_(0) {}
+
+    // 追加一段数据，和上一段在内存中连续且属于同一个对象时合并
+    void Append(const char *data, size_t len, std::shared_ptr<const void> owner = nullptr, bool mapped = false);
+    void Append(std::string_view data, std::shared_ptr<const void> owner = nullptr, bool mapped = false)
+    {
+        Append(data.data(), data.size(), std::move(owner), mapped);
+    }
+
+    size_t Bytes() const { return bytes_; } // 剩余待发送的字节数
+    bool Empty() const { return bytes_ == 0; }
+
+    // 从头开始发送最多limit字节，返回writev的结果，已发送的部分从链中移除
+    ssize_t WriteFd(int fd, size_t limit);
+
+    // 依次对待发送的前limit字节中的每一段调用fn(slice, len)，返回遍历的总字节数
+    template <typename F>
+    size_t ForEach(size_t limit, F fn) const
+    {
+        size_t total = 0;
+        for (size_t i = head_; i < slices_.size() && total < limit; ++i)
+        {
+            size_t len = std::min(slices_[i].len, limit - total);
+            fn(slices_[i], len);
+            total += len;
+        }
+        return total;
+    }
+
+    // 丢弃所有数据，保留已分配的空间
+    void Clear();
+    // 丢弃所有数据并释放空间，连接空闲时调用
+    void Reset();
+
+private:
+    void Consume_(size_t n);
+
+    // 一次writev最多使用的片段数
+    static const int MAX_IOV = IOV_MAX;
+
+    std::vector<OutputSlice> slices_;
+    size_t head_;  // 第一个没有发送完的片段
+    size_t bytes_; // 剩余待发送的字节数
+};
+
+#endif
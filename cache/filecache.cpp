@@ -0,0 +1,186 @@
+#include "filecache.h"
+#include <zlib.h>
+
+FileCache::FileCache()
+    : gzipLevel_(6), minGzipSize_(1024), maxGzipSize_(4 * 1024 * 1024), maxEntries_(1024),
+      populate_(false), lock_(false), hugePageMinSize_(0) {}
+
+FileCache *FileCache::Instance()
+{
+    static FileCache inst;
+    return &inst;
+}
+
+void FileCache::init(int gzipLevel, size_t minGzipSize, size_t maxGzipSize, size_t maxEntries)
+{
+    std::lock_guard<std::mutex> locker(mtx_);
+    gzipLevel_ = gzipLevel;
+    minGzipSize_ = minGzipSize;
+    maxGzipSize_ = maxGzipSize;
+    maxEntries_ = maxEntries > 0 ? maxEntries : 1;
+}
+
+void FileCache::SetMapOptions(bool populate, bool lock, size_t hugePageMinSize)
+{
+    std::lock_guard<std::mutex> locker(mtx_);
+    populate_ = populate;
+    lock_ = lock;
+    hugePageMinSize_ = hugePageMinSize;
+}
+
+size_t FileCache::Size()
+{
+    std::lock_guard<std::mutex> locker(mtx_);
+    return lru_.size();
+}
+
+size_t FileCache::MaxEntries()
+{
+    std::lock_guard<std::mutex> locker(mtx_);
+    return maxEntries_;
+}
+
+std::string FileCache::Key_(const char *path, const char *typePath)
+{
+    std::string key(path);
+    if (typePath)
+    {
+        // 文件路径中不会出现'\0'
+        key.push_back('\0');
+        key.append(typePath);
+    }
+    return key;
+}
+
+std::shared_ptr<FileEntry> FileCache::Get(const char *path, const struct stat &st, const char *typePath)
+{
+    std::string key = Key_(path, typePath);
+    {
+        std::lock_guard<std::mutex> locker(mtx_);
+        auto it = map_.find(key);
+        if (it != map_.end())
+        {
+            std::shared_ptr<FileEntry> entry = *it->second;
+            if (entry->ino == st.st_ino && entry->mtime == st.st_mtime && entry->size == st.st_size)
+            {
+                // 命中，移动到链表头部
+                lru_.splice(lru_.begin(), lru_, it->second);
+                return entry;
+            }
+            // 文件已变化，丢弃旧的缓存项，正在发送它的连接仍持有引用
+            lru_.erase(it->second);
+            map_.erase(it);
+        }
+    }
+
+    // 映射文件不持有锁，避免阻塞其他线程
+    std::shared_ptr<FileEntry> entry = Map_(path, st);
+    if (!entry)
+    {
+        return nullptr;
+    }
+    entry->key = std::move(key);
+    entry->mime = &mimetypes::Lookup(typePath ? typePath : path);
+
+    std::lock_guard<std::mutex> locker(mtx_);
+    auto it = map_.find(entry->key);
+    if (it != map_.end())
+    {
+        // 其他线程已经放入了同一个文件
+        lru_.erase(it->second);
+        map_.erase(it);
+    }
+    lru_.push_front(entry);
+    map_[entry->key] = lru_.begin();
+    while (lru_.size() > maxEntries_)
+    {
+        map_.erase(lru_.back()->key);
+        lru_.pop_back();
+    }
+    return entry;
+}
+
+std::shared_ptr<FileEntry> FileCache::Map_(const char *path, const struct stat &st)
+{
+    std::shared_ptr<FileEntry> entry = std::make_shared<FileEntry>();
+    entry->path = path;
+    entry->size = st.st_size;
+    entry->ino = st.st_ino;
+    entry->mtime = st.st_mtime;
+
+    // 空文件不需要映射
+    if (st.st_size == 0)
+    {
+        return entry;
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return nullptr;
+    }
+    void *addr = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE | (populate_ ? MAP_POPULATE : 0), fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+    {
+        return nullptr;
+    }
+    entry->addr = (char *)addr;
+
+    // 大文件建议使用透明大页，减少TLB缺失；内核不支持文件页的大页时忽略
+    if (hugePageMinSize_ > 0 && (size_t)st.st_size >= hugePageMinSize_)
+    {
+        madvise(addr, st.st_size, MADV_HUGEPAGE);
+    }
+    // 超过RLIMIT_MEMLOCK时锁定失败，仍然正常使用
+    if (lock_)
+    {
+        entry->locked = mlock(addr, st.st_size) == 0;
+    }
+    return entry;
+}
+
+std::shared_ptr<const std::string> FileCache::Gzip(const std::shared_ptr<FileEntry> &entry)
+{
+    if (gzipLevel_ <= 0 || (size_t)entry->size < minGzipSize_ || (size_t)entry->size > maxGzipSize_
+            || !entry->mime->compressible)
+    {
+        return nullptr;
+    }
+    // 同一个文件只压缩一次，其他线程等待压缩完成后直接使用结果
+    std::call_once(entry->gzipOnce, [&]() {
+        std::shared_ptr<const std::string> gz = Compress_(entry->addr, entry->size, gzipLevel_);
+        // 压缩后没有变小就不使用
+        if (gz && gz->size() < (size_t)entry->size)
+        {
+            entry->gzip = gz;
+        }
+    });
+    return entry->gzip;
+}
+
+std::shared_ptr<const std::string> FileCache::Compress_(const char *data, size_t len, int level)
+{
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    // windowBits + 16：输出gzip格式而不是zlib格式
+    if (deflateInit2(&zs, level, Z_DEFLATED, MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        return nullptr;
+    }
+    std::string out;
+    out.resize(deflateBound(&zs, len));
+    zs.next_in = (Bytef *)data;
+    zs.avail_in = len;
+    zs.next_out = (Bytef *)&out[0];
+    zs.avail_out = out.size();
+    int ret = deflate(&zs, Z_FINISH);
+    size_t outLen = zs.total_out;
+    deflateEnd(&zs);
+    if (ret != Z_STREAM_END)
+    {
+        return nullptr;
+    }
+    out.resize(outLen);
+    return std::make_shared<const std::string>(std::move(out));
+}
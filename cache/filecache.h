@@ -0,0 +1,97 @@
+// 文件缓存，保存文件的内存映射以及按需生成的gzip压缩内容
+// 以文件路径为键，inode/修改时间/大小任何一个变化都会重新映射，旧的缓存项在没有连接使用后自动释放
+
+#ifndef FILECACHE_H
+#define FILECACHE_H
+
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <list>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include "../http/mimetypes.h"
+
+// 一个被缓存的文件
+struct FileEntry
+{
+    FileEntry() : addr(nullptr), size(0), ino(0), mtime(0), locked(false), mime(&mimetypes::DEFAULT) {}
+    ~FileEntry()
+    {
+        if (addr)
+        {
+            munmap(addr, size);
+        }
+    }
+
+    std::string path;
+    std::string key; // 缓存键
+    char *addr;  // 文件被mmap到内存中的起始位置，空文件为nullptr
+    off_t size;  // 文件大小
+    ino_t ino;   // 用于判断文件是否被替换
+    time_t mtime; // 用于判断文件是否被修改
+    bool locked;  // 是否已用mlock锁定在内存中，munmap时自动解锁
+    const MimeType *mime; // 映射时解析一次，之后直接使用其中的Content-Type行
+
+    // gzip压缩后的内容，第一次需要时压缩一次，之后直接使用
+    std::once_flag gzipOnce;
+    std::shared_ptr<const std::string> gzip;
+};
+
+class FileCache
+{
+public:
+    static FileCache *Instance();
+
+    // gzipLevel：压缩等级1~9，0表示关闭实时压缩
+    // minGzipSize/maxGzipSize：只压缩大小在这个范围内的文件
+    // maxEntries：最多缓存的文件数
+    void init(int gzipLevel = 6, size_t minGzipSize = 1024,
+              size_t maxGzipSize = 4 * 1024 * 1024, size_t maxEntries = 1024);
+
+    // 根据路径和刚取得的stat信息获取缓存项，文件变化或不在缓存中时重新映射
+    // typePath：按哪个路径的扩展名确定类型，发送预压缩文件时传原文件的路径，
+    //           同一文件作为预压缩版本和直接请求时是两个不同的缓存项
+    // 失败返回nullptr
+    std::shared_ptr<FileEntry> Get(const char *path, const struct stat &st, const char *typePath = nullptr);
+
+    // 之后映射文件的方式，在启动预热前设置，预热完成后恢复默认值
+    // populate：映射时预先读入所有页；lock：用mlock锁定在内存中
+    // hugePageMinSize：不小于这个大小的文件建议内核使用透明大页，0表示不使用
+    void SetMapOptions(bool populate, bool lock, size_t hugePageMinSize);
+
+    // 当前缓存的文件数，达到MaxEntries()后再放入新文件会淘汰最久没有使用的文件
+    size_t Size();
+    size_t MaxEntries();
+
+    // 获取文件的gzip压缩内容，文件不适合压缩或压缩失败时返回nullptr
+    std::shared_ptr<const std::string> Gzip(const std::shared_ptr<FileEntry> &entry);
+
+private:
+    FileCache();
+    ~FileCache() = default;
+
+    std::shared_ptr<FileEntry> Map_(const char *path, const struct stat &st);
+    static std::string Key_(const char *path, const char *typePath);
+    static std::shared_ptr<const std::string> Compress_(const char *data, size_t len, int level);
+
+private:
+    int gzipLevel_;
+    size_t minGzipSize_;
+    size_t maxGzipSize_;
+    size_t maxEntries_;
+    bool populate_;
+    bool lock_;
+    size_t hugePageMinSize_;
+
+    typedef std::list<std::shared_ptr<FileEntry>> EntryList;
+    EntryList lru_; // 最近使用的在前面
+    std::unordered_map<std::string, EntryList::iterator> map_;
+    std::mutex mtx_;
+};
+
+#endif
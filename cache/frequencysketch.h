@@ -0,0 +1,92 @@
+// Count-Min Sketch频率估计，用于W-TinyLFU的准入判断
+// 每个计数器4位，一个uint64_t放16个计数器；总增加次数达到采样上限后所有计数器减半，
+// 使过去的热点逐渐冷却
+
+#ifndef FREQUENCYSKETCH_H
+#define FREQUENCYSKETCH_H
+
+#include <stdint.h>
+#include <vector>
+
+class FrequencySketch
+{
+public:
+    // capacity：缓存预计能容纳的对象个数
+    explicit FrequencySketch(size_t capacity = 1024) { Resize(capacity); }
+
+    void Resize(size_t capacity)
+    {
+        size_t words = 1;
+        while (words * 4 < capacity)
+        {
+            words <<= 1;
+        }
+        table_.assign(words, 0);
+        mask_ = words * 16 - 1;
+        sampleSize_ = capacity * 10;
+        size_ = 0;
+    }
+
+    // 记录一次访问
+    void Increment(uint64_t hash)
+    {
+        bool added = false;
+        for (int i = 0; i < DEPTH; ++i)
+        {
+            size_t idx = Index_(hash, i);
+            uint64_t &word = table_[idx >> 4];
+            int shift = (idx & 15) << 2;
+            if (((word >> shift) & 0xf) < 15)
+            {
+                word += 1ULL << shift;
+                added = true;
+            }
+        }
+        if (added && ++size_ >= sampleSize_)
+        {
+            Reset_();
+        }
+    }
+
+    // 估计访问频率（0~15），取几个计数器中的最小值
+    int Frequency(uint64_t hash) const
+    {
+        int freq = 15;
+        for (int i = 0; i < DEPTH; ++i)
+        {
+            size_t idx = Index_(hash, i);
+            int count = (table_[idx >> 4] >> ((idx & 15) << 2)) & 0xf;
+            freq = count < freq ? count : freq;
+        }
+        return freq;
+    }
+
+private:
+    static const int DEPTH = 4;
+
+    size_t Index_(uint64_t hash, int i) const
+    {
+        static const uint64_t SEEDS[DEPTH] = {0xc3a5c85c97cb3127ULL, 0xb492b66fbe98f273ULL,
+                                              0x9ae16a3b2f90404fULL, 0xcbf29ce484222325ULL};
+        uint64_t h = (hash + SEEDS[i]) * SEEDS[(i + 1) % DEPTH];
+        h ^= h >> 32;
+        return h & mask_;
+    }
+
+    // 所有计数器减半
+    void Reset_()
+    {
+        for (uint64_t &word : table_)
+        {
+            word = (word >> 1) & 0x7777777777777777ULL;
+        }
+        size_ /= 2;
+    }
+
+    std::vector<uint64_t> table_;
+    size_t mask_;
+    size_t sampleSize_;
+    size_t size_;
+};
+
+#endif
@@ -0,0 +1,162 @@
+#include "negativecache.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/inotify.h>
+
+NegativeCache::NegativeCache() : mask_(0), ttl_(0), inotifyFd_(-1) {}
+
+NegativeCache::~NegativeCache()
+{
+    if (inotifyFd_ >= 0)
+    {
+        close(inotifyFd_);
+    }
+}
+
+NegativeCache *NegativeCache::Instance()
+{
+    static NegativeCache inst;
+    return &inst;
+}
+
+void NegativeCache::init(size_t slots, int ttl)
+{
+    ttl_ = ttl;
+    if (slots == 0 || ttl <= 0)
+    {
+        slots_.reset();
+        mask_ = 0;
+        return;
+    }
+    size_t n = 1;
+    while (n < slots)
+    {
+        n <<= 1;
+    }
+    slots_.reset(new Slot[n]);
+    mask_ = n - 1;
+    Clear();
+}
+
+uint64_t NegativeCache::Hash_(std::string_view url)
+{
+    // FNV-1a，0留给空槽
+    uint64_t h = 14695981039346656037ULL;
+    for (char c : url)
+    {
+        h = (h ^ (unsigned char)c) * 1099511628211ULL;
+    }
+    return h ? h : 1;
+}
+
+bool NegativeCache::Contains(std::string_view url) const
+{
+    if (!slots_)
+    {
+        return false;
+    }
+    uint64_t h = Hash_(url);
+    const Slot &slot = slots_[h & mask_];
+    if (slot.hash.load(std::memory_order_relaxed) != h)
+    {
+        return false;
+    }
+    // 粗粒度时钟走vDSO，比time()更便宜
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    return slot.expire.load(std::memory_order_relaxed) > ts.tv_sec;
+}
+
+void NegativeCache::Insert(std::string_view url)
+{
+    if (!slots_)
+    {
+        return;
+    }
+    uint64_t h = Hash_(url);
+    Slot &slot = slots_[h & mask_];
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    slot.expire.store(ts.tv_sec + ttl_, std::memory_order_relaxed);
+    slot.hash.store(h, std::memory_order_relaxed);
+}
+
+void NegativeCache::Clear()
+{
+    for (size_t i = 0; slots_ && i <= mask_; ++i)
+    {
+        slots_[i].hash.store(0, std::memory_order_relaxed);
+        slots_[i].expire.store(0, std::memory_order_relaxed);
+    }
+}
+
+int NegativeCache::Watch(const char *root)
+{
+    if (!slots_)
+    {
+        return -1;
+    }
+    inotifyFd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd_ < 0)
+    {
+        return -1;
+    }
+    AddWatch_(root);
+    return inotifyFd_;
+}
+
+// 递归监视目录及其子目录
+void NegativeCache::AddWatch_(const std::string &dir)
+{
+    int wd = inotify_add_watch(inotifyFd_, dir.c_str(), IN_CREATE | IN_MOVED_TO | IN_ONLYDIR);
+    if (wd < 0)
+    {
+        return;
+    }
+    watches_[wd] = dir;
+
+    DIR *d = opendir(dir.c_str());
+    if (!d)
+    {
+        return;
+    }
+    while (struct dirent *ent = readdir(d))
+    {
+        if (ent->d_type == DT_DIR && strcmp(ent->d_name, ".") != 0 && strcmp(ent->d_name, "..") != 0)
+        {
+            AddWatch_(dir + "/" + ent->d_name);
+        }
+    }
+    closedir(d);
+}
+
+void NegativeCache::HandleEvents()
+{
+    alignas(struct inotify_event) char buf[4096];
+    bool changed = false;
+    ssize_t len;
+    while ((len = read(inotifyFd_, buf, sizeof(buf))) > 0)
+    {
+        for (char *p = buf; p < buf + len;)
+        {
+            struct inotify_event *ev = (struct inotify_event *)p;
+            if ((ev->mask & IN_ISDIR) && ev->len > 0)
+            {
+                // 新目录也需要监视
+                auto it = watches_.find(ev->wd);
+                if (it != watches_.end())
+                {
+                    AddWatch_(it->second + "/" + ev->name);
+                }
+            }
+            changed = true;
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+    if (changed)
+    {
+        Clear();
+    }
+}
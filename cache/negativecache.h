@@ -0,0 +1,63 @@
+// 不存在路径的缓存
+// 扫描器会请求大量不存在的路径，每次都要拼接路径并stat失败。这里记录最近确认不存在的URL，
+// 有效期内再次请求直接返回404，不需要任何系统调用。
+// 只保存URL的64位哈希，固定大小的直接映射表，无锁读写：表中的每个哈希都对应某个曾经不存在的URL，
+// 并发读写最多让某个URL的记录提前失效或晚几秒失效。
+// 可以用inotify监视网站根目录，有文件或目录被创建、移入时清空整个表。
+
+#ifndef NEGATIVECACHE_H
+#define NEGATIVECACHE_H
+
+#include <time.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+class NegativeCache
+{
+public:
+    static NegativeCache *Instance();
+
+    // slots：表的大小（向上取2的幂），0表示关闭；ttl：记录的有效秒数
+    void init(size_t slots, int ttl);
+
+    // URL最近被确认不存在
+    bool Contains(std::string_view url) const;
+
+    // 记录URL不存在
+    void Insert(std::string_view url);
+
+    // 清空所有记录
+    void Clear();
+
+    // 监视目录树中新建的文件，返回inotify文件描述符（非阻塞），失败返回-1
+    int Watch(const char *root);
+
+    // inotify描述符可读时调用，读出所有事件并清空缓存
+    void HandleEvents();
+
+private:
+    NegativeCache();
+    ~NegativeCache();
+
+    struct Slot
+    {
+        std::atomic<uint64_t> hash;
+        std::atomic<time_t> expire;
+    };
+
+    static uint64_t Hash_(std::string_view url);
+    void AddWatch_(const std::string &dir);
+
+private:
+    std::unique_ptr<Slot[]> slots_;
+    size_t mask_;
+    int ttl_;
+
+    int inotifyFd_;
+    std::unordered_map<int, std::string> watches_; // 监视描述符 -> 目录
+};
+
+#endif
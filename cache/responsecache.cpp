@@ -0,0 +1,175 @@
+#include "responsecache.h"
+
+ResponseCache::ResponseCache()
+    : capacity_(0), maxObjectSize_(0), windowCapacity_(0), protectedCapacity_(0),
+      windowBytes_(0), probationBytes_(0), protectedBytes_(0) {}
+
+ResponseCache *ResponseCache::Instance()
+{
+    static ResponseCache inst;
+    return &inst;
+}
+
+void ResponseCache::init(size_t capacity, size_t maxObjectSize)
+{
+    std::lock_guard<std::mutex> locker(mtx_);
+    capacity_ = capacity;
+    maxObjectSize_ = maxObjectSize;
+    // 窗口占1%，但至少能放下一个最大的对象
+    windowCapacity_ = capacity / 100;
+    if (windowCapacity_ < maxObjectSize * 2)
+    {
+        windowCapacity_ = maxObjectSize * 2;
+    }
+    if (windowCapacity_ > capacity)
+    {
+        windowCapacity_ = capacity;
+    }
+    protectedCapacity_ = (capacity - windowCapacity_) / 5 * 4;
+    // 按平均半个最大对象估计对象个数
+    sketch_.Resize(maxObjectSize > 0 ? capacity / (maxObjectSize / 2 + 1) + 16 : 16);
+}
+
+std::shared_ptr<const CachedResponse> ResponseCache::Get(std::string_view key)
+{
+    std::shared_ptr<CachedResponse> entry;
+    {
+        std::lock_guard<std::mutex> locker(mtx_);
+        // 命中和未命中都计入频率，准入时以此判断对象是否值得缓存
+        sketch_.Increment(Hash_(key));
+        auto it = map_.find(key);
+        if (it == map_.end())
+        {
+            return nullptr;
+        }
+        entry = *it->second;
+        switch (entry->region)
+        {
+        case WINDOW:
+            window_.splice(window_.begin(), window_, it->second);
+            break;
+        case PROBATION:
+            // 试用区再次命中，晋升到保护区
+            probation_.erase(it->second);
+            probationBytes_ -= entry->Charge();
+            Insert_(protected_, protectedBytes_, PROTECTED, entry);
+            while (protectedBytes_ > protectedCapacity_ && protected_.size() > 1)
+            {
+                // 保护区超出容量，最久未用的降级回试用区
+                std::shared_ptr<CachedResponse> demoted = protected_.back();
+                protected_.pop_back();
+                protectedBytes_ -= demoted->Charge();
+                Insert_(probation_, probationBytes_, PROBATION, demoted);
+            }
+            break;
+        default:
+            protected_.splice(protected_.begin(), protected_, it->second);
+            break;
+        }
+    }
+
+    // 每秒最多检查一次源文件是否变化，stat不持有锁
+    time_t now = time(nullptr);
+    time_t checked = entry->checked.load(std::memory_order_relaxed);
+    if (checked != now && entry->checked.compare_exchange_strong(checked, now))
+    {
+        struct stat st;
+        if (stat(entry->path.c_str(), &st) < 0 || st.st_ino != entry->ino
+                || st.st_mtime != entry->mtime || st.st_size != entry->size)
+        {
+            std::lock_guard<std::mutex> locker(mtx_);
+            auto it = map_.find(key);
+            if (it != map_.end() && *it->second == entry)
+            {
+                Remove_(entry);
+            }
+            return nullptr;
+        }
+    }
+    return entry;
+}
+
+void ResponseCache::Put(std::shared_ptr<CachedResponse> resp)
+{
+    if (!Enabled() || resp->data.size() > maxObjectSize_ * 2)
+    {
+        return;
+    }
+    resp->checked.store(time(nullptr));
+
+    std::lock_guard<std::mutex> locker(mtx_);
+    if (map_.count(resp->key))
+    {
+        // 其他线程已经放入
+        return;
+    }
+    Insert_(window_, windowBytes_, WINDOW, resp);
+
+    // 窗口超出容量，淘汰出来的对象作为候选尝试进入主区
+    while (windowBytes_ > windowCapacity_ && !window_.empty())
+    {
+        std::shared_ptr<CachedResponse> candidate = window_.back();
+        window_.pop_back();
+        windowBytes_ -= candidate->Charge();
+        Admit_(candidate);
+    }
+}
+
+size_t ResponseCache::Bytes()
+{
+    std::lock_guard<std::mutex> locker(mtx_);
+    return windowBytes_ + probationBytes_ + protectedBytes_;
+}
+
+// 候选者的访问频率必须高于主区的淘汰者才能进入主区，否则直接丢弃
+void ResponseCache::Admit_(std::shared_ptr<CachedResponse> candidate)
+{
+    size_t mainCapacity = capacity_ - windowCapacity_;
+    size_t charge = candidate->Charge();
+    int freq = sketch_.Frequency(Hash_(candidate->key));
+    while (probationBytes_ + protectedBytes_ + charge > mainCapacity)
+    {
+        EntryList &victims = probation_.empty() ? protected_ : probation_;
+        if (victims.empty() || freq <= sketch_.Frequency(Hash_(victims.back()->key)))
+        {
+            map_.erase(candidate->key);
+            return;
+        }
+        Remove_(victims.back());
+    }
+    Insert_(probation_, probationBytes_, PROBATION, candidate);
+}
+
+void ResponseCache::Insert_(EntryList &list, size_t &bytes, int region, std::shared_ptr<CachedResponse> entry)
+{
+    entry->region = region;
+    bytes += entry->Charge();
+    list.push_front(entry);
+    map_[entry->key] = list.begin();
+}
+
+void ResponseCache::Remove_(const std::shared_ptr<CachedResponse> &entry)
+{
+    auto it = map_.find(entry->key);
+    if (it == map_.end())
+    {
+        return;
+    }
+    EntryList::iterator pos = it->second;
+    map_.erase(it);
+    switch (entry->region)
+    {
+    case WINDOW:
+        windowBytes_ -= entry->Charge();
+        window_.erase(pos);
+        break;
+    case PROBATION:
+        probationBytes_ -= entry->Charge();
+        probation_.erase(pos);
+        break;
+    default:
+        protectedBytes_ -= entry->Charge();
+        protected_.erase(pos);
+        break;
+    }
+}
@@ -0,0 +1,98 @@
+// 小文件的完整响应缓存
+// 缓存 状态行 + 实体头部 + 空行 + 文件内容 组成的连续内存，命中时不需要do_request和process_write，
+// 发送时在状态行之后插入当前这一秒的公共头部（Date等），一次writev发出
+//
+// 按字节数限制容量，使用W-TinyLFU淘汰：新对象先进入占1%容量的窗口LRU，
+// 从窗口淘汰出来后与主区（分段LRU：试用区20%、保护区80%）的淘汰候选比较访问频率，
+// 频率更高才能进入主区，所以扫描器的一次性请求不会把热点挤出去
+
+#ifndef RESPONSECACHE_H
+#define RESPONSECACHE_H
+
+#include <sys/stat.h>
+#include <time.h>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include "frequencysketch.h"
+
+struct CachedResponse
+{
+    std::string key;
+    std::string data;       // 状态行 + 实体头部 + 空行 + 文件内容，不含公共头部
+    size_t statusLen;       // 状态行的长度，公共头部插在它后面
+
+    // 源文件，用于发现文件变化
+    std::string path;
+    ino_t ino;
+    time_t mtime;
+    off_t size;
+    std::atomic<time_t> checked; // 上次检查源文件的时间
+
+    int region; // 所在的区域，见ResponseCache::Region
+
+    size_t Charge() const { return key.size() + data.size() + path.size() + sizeof(*this); }
+};
+
+class ResponseCache
+{
+public:
+    static ResponseCache *Instance();
+
+    // capacity：缓存总字节数，0表示关闭；maxObjectSize：只缓存不超过这个大小的文件
+    void init(size_t capacity, size_t maxObjectSize);
+
+    bool Enabled() const { return capacity_ > 0; }
+    size_t MaxObjectSize() const { return maxObjectSize_; }
+
+    // 查找响应，源文件已改变时删除并返回nullptr
+    std::shared_ptr<const CachedResponse> Get(std::string_view key);
+
+    // 放入新生成的响应，由W-TinyLFU决定是否保留
+    void Put(std::shared_ptr<CachedResponse> resp);
+
+    // 当前缓存的响应总字节数
+    size_t Bytes();
+
+private:
+    enum Region
+    {
+        WINDOW,
+        PROBATION,
+        PROTECTED
+    };
+
+    typedef std::list<std::shared_ptr<CachedResponse>> EntryList;
+
+    ResponseCache();
+    ~ResponseCache() = default;
+
+    static uint64_t Hash_(std::string_view key) { return std::hash<std::string_view>()(key); }
+    void Admit_(std::shared_ptr<CachedResponse> candidate);
+    void Remove_(const std::shared_ptr<CachedResponse> &entry);
+    void Insert_(EntryList &list, size_t &bytes, int region, std::shared_ptr<CachedResponse> entry);
+
+private:
+    size_t capacity_;
+    size_t maxObjectSize_;
+    size_t windowCapacity_;
+    size_t protectedCapacity_;
+
+    EntryList window_;
+    EntryList probation_;
+    EntryList protected_;
+    size_t windowBytes_;
+    size_t probationBytes_;
+    size_t protectedBytes_;
+
+    // 键是指向缓存项中key的string_view，查找时不需要构造std::string
+    std::unordered_map<std::string_view, EntryList::iterator> map_;
+    FrequencySketch sketch_;
+    std::mutex mtx_;
+};
+
+#endif
@@ -0,0 +1,60 @@
+# 用法：cmake -DEMBED_DIR=<资源目录> -DOUTPUT=<生成的.cpp> -P embed.cmake
+# 把资源目录下的所有文件生成为constexpr字节数组，同时预先生成Content-Length和ETag头部
+# EMBED_DIR为空时生成空表；预压缩的.gz/.br兄弟文件不嵌入
+
+if( NOT OUTPUT )
+    message( FATAL_ERROR "OUTPUT is not set" )
+endif()
+
+set( assets "" )
+if( EMBED_DIR )
+    file( GLOB_RECURSE assets RELATIVE ${EMBED_DIR} ${EMBED_DIR}/* )
+    list( FILTER assets EXCLUDE REGEX "\\.(gz|br)$" )
+    # 按字节序排序，服务器用二分查找
+    list( SORT assets )
+endif()
+
+# 每行32个字节
+string( REPEAT "[0-9a-f]" 64 line_regex )
+
+set( arrays "" )
+set( entries "" )
+set( index 0 )
+foreach( asset ${assets} )
+    set( file ${EMBED_DIR}/${asset} )
+    file( SIZE ${file} size )
+    file( SHA1 ${file} sha1 )
+    string( SUBSTRING ${sha1} 0 16 etag )
+
+    # 每个字节写成\xNN，所有字节都被转义，不会和后面的字符连成一个转义序列
+    file( READ ${file} hex HEX )
+    string( REGEX REPLACE "(${line_regex})" "\\1\n" hex "${hex}" )
+    string( REGEX REPLACE "([0-9a-f][0-9a-f])" "\\\\x\\1" hex "${hex}" )
+    string( REGEX REPLACE "\n$" "" hex "${hex}" )
+    string( REPLACE "\n" "\"\n    \"" hex "${hex}" )
+
+    string( APPEND arrays "// ${asset}\nstatic constexpr char ASSET_${index}[] =\n    \"${hex}\";\n\n" )
+    string( APPEND entries
+        "    {\"/${asset}\", std::string_view(ASSET_${index}, ${size}), \"\\\"${etag}\\\"\",\n"
+        "     \"ETag: \\\"${etag}\\\"\\r\\n\", \"Content-Length: ${size}\\r\\n\", &mimetypes::Lookup(\"/${asset}\")},\n" )
+    math( EXPR index "${index} + 1" )
+endforeach()
+
+if( index GREATER 0 )
+    string( CONCAT table "static constexpr EmbeddedAsset ASSETS[] = {\n${entries}};\n\n"
+                         "const EmbeddedAsset *const EMBEDDED_ASSETS = ASSETS;\n" )
+else()
+    set( table "const EmbeddedAsset *const EMBEDDED_ASSETS = nullptr;\n" )
+endif()
+
+file( WRITE ${OUTPUT}.tmp
+"// 由cmake/embed.cmake生成，不要手动修改
+
+#include \"http/embedded.h\"
+
+${arrays}${table}const size_t EMBEDDED_ASSET_COUNT = ${index};
+" )
+
+# 内容没有变化时不更新文件，避免重新编译
+file( COPY_FILE ${OUTPUT}.tmp ${OUTPUT} ONLY_IF_DIFFERENT )
+file( REMOVE ${OUTPUT}.tmp )
@@ -0,0 +1,24 @@
+# 用法：cmake -DDOC_ROOT=<资源目录> -P precompress.cmake
+# 对文本类资源生成 xxx.gz（gzip -9）和 xxx.br（brotli -q 11），已有且不比原文件旧的跳过
+
+if( NOT DOC_ROOT )
+    message( FATAL_ERROR "DOC_ROOT is not set" )
+endif()
+
+find_program( GZIP_EXECUTABLE gzip )
+find_program( BROTLI_EXECUTABLE brotli )
+
+file( GLOB_RECURSE assets
+    ${DOC_ROOT}/*.html ${DOC_ROOT}/*.css ${DOC_ROOT}/*.js
+    ${DOC_ROOT}/*.svg ${DOC_ROOT}/*.json ${DOC_ROOT}/*.txt )
+
+foreach( asset ${assets} )
+    if( GZIP_EXECUTABLE AND ( NOT EXISTS ${asset}.gz OR ${asset} IS_NEWER_THAN ${asset}.gz ) )
+        execute_process( COMMAND ${GZIP_EXECUTABLE} -kf9 ${asset} )
+        message( STATUS "gzip   ${asset}" )
+    endif()
+    if( BROTLI_EXECUTABLE AND ( NOT EXISTS ${asset}.br OR ${asset} IS_NEWER_THAN ${asset}.br ) )
+        execute_process( COMMAND ${BROTLI_EXECUTABLE} -kf -q 11 ${asset} )
+        message( STATUS "brotli ${asset}" )
+    endif()
+endforeach()
@@ -0,0 +1,60 @@
+#include "commonheaders.h"
+#include <stdio.h>
+#include <string.h>
+
+CommonHeaders::Block CommonHeaders::blocks_[CommonHeaders::SLOTS];
+std::atomic<CommonHeaders::Block *> CommonHeaders::current_{nullptr};
+std::atomic<time_t> CommonHeaders::formatted_{0};
+char CommonHeaders::serverLine_[64] = "Server: WebServer-dev\r\n";
+char CommonHeaders::keepAliveLine_[64] = "";
+
+void CommonHeaders::init(const char *serverName, int keepAliveTimeout)
+{
+    snprintf(serverLine_, sizeof(serverLine_), "Server: %s\r\n", serverName);
+    snprintf(keepAliveLine_, sizeof(keepAliveLine_), "Keep-Alive: timeout=%d\r\n", keepAliveTimeout);
+    time_t now = time(nullptr);
+    formatted_.store(now);
+    Update_(now);
+}
+
+std::string_view CommonHeaders::Get(bool keepAlive)
+{
+    // CLOCK_REALTIME_COARSE走vDSO，不陷入内核
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+
+    Block *b = current_.load(std::memory_order_acquire);
+    if (!b || b->sec != ts.tv_sec)
+    {
+        // 只有一个线程负责格式化新的一秒，其他线程继续使用上一秒的内容
+        time_t last = formatted_.load(std::memory_order_relaxed);
+        if (last != ts.tv_sec && formatted_.compare_exchange_strong(last, ts.tv_sec))
+        {
+            Update_(ts.tv_sec);
+        }
+        b = current_.load(std::memory_order_acquire);
+        if (!b)
+        {
+            return {};
+        }
+    }
+    return keepAlive ? std::string_view(b->keepAlive, b->keepAliveLen)
+                     : std::string_view(b->close, b->closeLen);
+}
+
+void CommonHeaders::Update_(time_t now)
+{
+    Block *b = &blocks_[now % SLOTS];
+    struct tm t;
+    gmtime_r(&now, &t);
+    char date[64];
+    strftime(date, sizeof(date), "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &t);
+
+    int n = snprintf(b->keepAlive, BLOCK_LEN, "%s%sConnection: keep-alive\r\n%s",
+                     serverLine_, date, keepAliveLine_);
+    b->keepAliveLen = n < BLOCK_LEN ? n : BLOCK_LEN - 1;
+    n = snprintf(b->close, BLOCK_LEN, "%s%sConnection: close\r\n", serverLine_, date);
+    b->closeLen = n < BLOCK_LEN ? n : BLOCK_LEN - 1;
+    b->sec = now;
+    current_.store(b, std::memory_order_release);
+}
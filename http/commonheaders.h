@@ -0,0 +1,43 @@
+// 每个响应都要带的公共头部：Server、Date、Connection/Keep-Alive
+// Date每秒最多格式化一次，格式化好的整块头部轮流存放在几个槽中，用原子指针切换，
+// process_write只需要一次memcpy，不需要每次调用time/gmtime/strftime
+
+#ifndef COMMONHEADERS_H
+#define COMMONHEADERS_H
+
+#include <time.h>
+#include <atomic>
+#include <string_view>
+
+class CommonHeaders
+{
+public:
+    // serverName：Server头的内容；keepAliveTimeout：空闲长连接被关闭前的秒数
+    static void init(const char *serverName, int keepAliveTimeout);
+
+    // 返回当前这一秒的公共头部块，以\r\n结尾
+    static std::string_view Get(bool keepAlive);
+
+private:
+    static const int BLOCK_LEN = 256;
+    static const int SLOTS = 4; // 按秒数轮流使用，槽被重写前至少经过SLOTS-1秒，读者早已拷贝完成
+
+    struct Block
+    {
+        time_t sec;
+        char keepAlive[BLOCK_LEN];
+        size_t keepAliveLen;
+        char close[BLOCK_LEN];
+        size_t closeLen;
+    };
+
+    static void Update_(time_t now);
+
+    static Block blocks_[SLOTS];
+    static std::atomic<Block *> current_;
+    static std::atomic<time_t> formatted_; // 最近一次开始格式化的秒数，用于选出唯一的更新者
+    static char serverLine_[64];
+    static char keepAliveLine_[64];
+};
+
+#endif
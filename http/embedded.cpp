@@ -0,0 +1,10 @@
+#include "embedded.h"
+#include <algorithm>
+
+const EmbeddedAsset *embedded::Find(std::string_view url)
+{
+    const EmbeddedAsset *end = EMBEDDED_ASSETS + EMBEDDED_ASSET_COUNT;
+    const EmbeddedAsset *it = std::lower_bound(EMBEDDED_ASSETS, end, url,
+        [](const EmbeddedAsset &asset, std::string_view key) { return asset.path < key; });
+    return it != end && it->path == url ? it : nullptr;
+}
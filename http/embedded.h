@@ -0,0 +1,31 @@
+// 编译时嵌入程序的静态资源，由cmake/embed.cmake根据资源目录生成
+// 嵌入模式下直接从这张表响应请求，不访问文件系统
+
+#ifndef EMBEDDED_H
+#define EMBEDDED_H
+
+#include <stddef.h>
+#include <string_view>
+#include "mimetypes.h"
+
+struct EmbeddedAsset
+{
+    std::string_view path;       // URL路径，如/index.html
+    std::string_view body;       // 文件内容
+    std::string_view etag;       // 带引号的ETag，用于匹配If-None-Match
+    std::string_view etagLine;   // 预先生成的ETag头部
+    std::string_view lengthLine; // 预先生成的Content-Length头部
+    const MimeType *mime;
+};
+
+// 定义在生成的embedded_assets.cpp中，按path的字节序排序
+extern const EmbeddedAsset *const EMBEDDED_ASSETS;
+extern const size_t EMBEDDED_ASSET_COUNT;
+
+namespace embedded
+{
+    // 查找URL对应的嵌入资源，没有时返回nullptr
+    const EmbeddedAsset *Find(std::string_view url);
+}
+
+#endif
@@ -1,22 +1,39 @@
 #include "./httpConn.h"
-
-// 网站的工作目录
-const char *doc_root = "/home/cnu/WebServer-dev/resources";
+#include "../pool/threadpool.h"
+#include "../log/log.h"
+#include "../log/accesslog.h"
+
+// 网站的工作目录，由CMake的DOC_ROOT指定，运行时可以用-r覆盖
+#ifndef DOC_ROOT
+#define DOC_ROOT "./resources"
+#endif
+const char *doc_root = DOC_ROOT;
 // ./server 10000
 // http://192.168.56.101:10000/index.html
 // sudo chmod 777 index.html 修改访问权限
 
 
-// 定义HTTP响应的一些状态信息
-const char* ok_200_title = "OK";
-const char* error_400_title = "Bad Request";
-const char* error_400_form = "Your request has bad syntax or is inherently impossible to satisfy.\n";
-const char* error_403_title = "Forbidden";
-const char* error_403_form = "You do not have permission to get file from this server.\n";
-const char* error_404_title = "Not Found";
-const char* error_404_form = "The requested file was not found on this server.\n";
-const char* error_500_title = "Internal Error";
-const char* error_500_form = "There was an unusual problem serving the requested file.\n";
+// 定义HTTP响应的一些状态信息，状态行见httpheader.h
+constexpr std::string_view error_400_form = "Your request has bad syntax or is inherently impossible to satisfy.\n";
+constexpr std::string_view error_403_form = "You do not have permission to get file from this server.\n";
+constexpr std::string_view error_404_form = "The requested file was not found on this server.\n";
+constexpr std::string_view error_500_form = "There was an unusual problem serving the requested file.\n";
+constexpr std::string_view error_416_form = "The requested range is not satisfiable.\n";
+
+// 访问日志中的请求方法，与METHOD的顺序一致
+const char* const METHOD_NAMES[] = {"GET", "POST", "HEAD", "PUT", "DELETE", "TRACE", "OPTIONS", "CONNECT"};
+
+// 预先拼好的404响应中状态行和公共头部之后的部分，扫描器的大量404只需要拷贝公共头部
+constexpr std::string_view error_404_tail =
+    "Content-Length: 49\r\n"
+    "Content-Type: text/html; charset=utf-8\r\n"
+    "\r\n"
+    "The requested file was not found on this server.\n";
+static_assert( error_404_form.size() == 49, "update Content-Length in error_404_tail" );
+static_assert( error_404_tail.ends_with( error_404_form ) );
+
+// multipart/byteranges的分隔符序号，每个多区间响应使用不同的分隔符
+static std::atomic<unsigned long> range_boundary_seq{0};
 
 
 // 设置某个文件描述符非阻塞
@@ -80,20 +97,28 @@ int setnonblocking( int fd ) {
 
 // 对静态变量初始化
 int HttpConn::m_epollfd = -1;
-int HttpConn::m_user_count = 0;
+ShardedCounter HttpConn::m_user_count;
+ThreadPool<PrefetchTask>* HttpConn::m_io_pool = NULL;
+bool HttpConn::m_embedded = false;
 
 
 // 非阻塞一次性读完数据
 bool HttpConn::read() {
-    printf("read client data\n");
-    if(m_read_idx >= READ_BUFFER_SIZE) return false;
+    // 空闲的keep-alive连接有新请求到来，重新借用缓冲区
+    if ( !m_bufs ) {
+        if ( !lease_buffers() ) {
+            return false;
+        }
+    }
+    // 最后一个字节留给结束符
+    if(m_read_idx >= READ_BUFFER_SIZE - 1) return false;
 
     // 读取到的字节
     int bytes_read = 0;
 
     // 循环一次性读完数据
     while(1){
-        bytes_read = recv(m_sockfd, m_read_buf + m_read_idx, sizeof(m_read_buf) - m_read_idx, 0);
+        bytes_read = recv(m_sockfd, m_read_buf + m_read_idx, READ_BUFFER_SIZE - 1 - m_read_idx, 0);
         if(bytes_read == -1) {
             if(errno == EAGAIN || errno == EWOULDBLOCK) {
                 // 表示非阻塞读取数据完毕，没有数据了，不是错误
@@ -107,26 +132,35 @@ bool HttpConn::read() {
 
         m_read_idx += bytes_read;
     }
-    printf("\n读取到的数据:%s\n", m_read_buf);
+    // 缓冲区不再清零，读入的数据之后补上结束符
+    m_read_buf[m_read_idx] = '\0';
+    m_read_time = AccessLog::Now();
+    m_request_pending = m_read_idx > 0;
+    LOG_DEBUG("fd %d read %d bytes", m_sockfd, m_read_idx);
     return true;
 }
 
 // 非阻塞一次性写HTTP响应
 bool HttpConn::write() {
-    int temp = 0;
-    int bytes_have_send = 0;    // 已经发送的字节
-    int bytes_to_send = m_write_idx;// 将要发送的字节 （m_write_idx）写缓冲区中待发送的字节数
+    ssize_t temp = 0;
 
-    if ( bytes_to_send == 0 ) {
+    if ( m_out.Empty() ) {
         // 将要发送的字节为0，这一次响应结束。
-        modfd( m_epollfd, m_sockfd, EPOLLIN );
         init();
+        release_buffers();
+        modfd( m_epollfd, m_sockfd, EPOLLIN );
         return true;
     }
 
     while(1) {
-        // 分散写
-        temp = writev(m_sockfd, m_iv, m_iv_count);
+        // 文件数据不在内存中时交给I/O线程预读，避免writev缺页阻塞当前线程
+        // 预读完成后由I/O线程重新注册EPOLLOUT
+        if ( m_resident_bytes == 0 && !check_resident() ) {
+            return true;
+        }
+
+        // 分散写输出链，从上次没写完的片段继续，只发送已确认在内存中的部分
+        temp = m_out.WriteFd( m_sockfd, m_resident_bytes );
         if ( temp <= -1 ) {
             // 如果TCP写缓冲没有空间，则等待下一轮EPOLLOUT事件，虽然在此期间，
             // 服务器无法立即接收到同一客户的下一个请求，但可以保证连接的完整性。
@@ -134,16 +168,21 @@ bool HttpConn::write() {
                 modfd( m_epollfd, m_sockfd, EPOLLOUT );
                 return true;
             }
+            // 发送失败，访问日志由close_conn记录
             unmap();
             return false;
         }
-        bytes_to_send -= temp;
-        bytes_have_send += temp;
-        if ( bytes_to_send <= bytes_have_send ) {
+        m_resident_bytes -= temp;
+        m_bytes_sent += temp;
+
+        if ( m_out.Empty() ) {
             // 发送HTTP响应成功，根据HTTP请求中的Connection字段决定是否立即关闭连接
+            log_access();
             unmap();
             if(m_keepAlive) {
+                // 等待下一个请求期间不占用缓冲区，EPOLLIN到来时在read()中重新借用
                 init();
+                release_buffers();
                 modfd( m_epollfd, m_sockfd, EPOLLIN );
                 return true;
             } else {
@@ -154,6 +193,106 @@ bool HttpConn::write() {
     }
 }
 
+// 遍历接下来最多PREFETCH_WINDOW字节的待发送数据，对其中属于文件映射的部分调用fn(addr, len)
+// 写缓冲区、压缩内容、缓存的响应都在堆上，不需要检查
+template <typename F>
+size_t HttpConn::for_each_file_window( F fn ) {
+    return m_out.ForEach( PREFETCH_WINDOW, [&]( const OutputSlice& slice, size_t len ) {
+        if ( slice.mapped ) {
+            fn( slice.data, len );
+        }
+    } );
+}
+
+static long page_size() {
+    static const long size = sysconf( _SC_PAGESIZE );
+    return size;
+}
+
+// 检查接下来要发送的文件数据是否都在page cache中，在则可以直接发送，
+// 否则提交给I/O线程池预读并返回false
+bool HttpConn::check_resident() {
+    const uintptr_t mask = page_size() - 1;
+    bool resident = true;
+    size_t total = for_each_file_window( [&]( const char* addr, size_t len ) {
+        if ( !resident ) {
+            return;
+        }
+        uintptr_t start = ( uintptr_t )addr & ~mask;
+        size_t pages = ( ( uintptr_t )addr + len - start + mask ) / page_size();
+        unsigned char vec[ PREFETCH_WINDOW / 4096 + 2 ];
+        if ( pages > sizeof( vec ) || mincore( ( void* )start, pages * page_size(), vec ) < 0 ) {
+            return;
+        }
+        for ( size_t i = 0; i < pages && resident; ++i ) {
+            resident = vec[ i ] & 1;
+        }
+    } );
+
+    if ( !resident && m_io_pool ) {
+        m_prefetch.generation = m_generation;
+        begin_task();
+        if ( m_io_pool->append( &m_prefetch ) ) {
+            return false;
+        }
+        end_task();
+    }
+    m_resident_bytes = total;
+    return true;
+}
+
+// 在I/O线程中预读：先提示内核异步读入，再逐页访问，缺页发生在I/O线程而不是写线程
+void HttpConn::prefetch() {
+    const uintptr_t mask = page_size() - 1;
+    size_t total = for_each_file_window( [&]( const char* addr, size_t len ) {
+        uintptr_t start = ( uintptr_t )addr & ~mask;
+        madvise( ( void* )start, ( uintptr_t )addr + len - start, MADV_WILLNEED );
+        volatile char sink = 0;
+        for ( const char* p = addr; p < addr + len; p += page_size() ) {
+            sink = sink + *p;
+        }
+        sink = sink + addr[ len - 1 ];
+    } );
+    m_resident_bytes = total;
+    if ( m_prefetch.generation == m_generation ) {
+        modfd( m_epollfd, m_sockfd, EPOLLOUT );
+    }
+}
+
+// 重新注册事件之后不再访问连接的其它状态，最后结束任务
+void PrefetchTask::process() {
+    conn->prefetch();
+    conn->end_task();
+}
+
+std::shared_ptr<FileEntry> HttpConn::warm( const char* url, const char* accept_encoding ) {
+    if ( !lease_buffers() ) {
+        return nullptr;
+    }
+    init();
+    int len;
+    if ( accept_encoding ) {
+        len = snprintf( m_read_buf, READ_BUFFER_SIZE, "GET %s HTTP/1.1\r\nAccept-Encoding: %s\r\n\r\n",
+                        url, accept_encoding );
+    } else {
+        len = snprintf( m_read_buf, READ_BUFFER_SIZE, "GET %s HTTP/1.1\r\n\r\n", url );
+    }
+    if ( len <= 0 || len >= READ_BUFFER_SIZE ) {
+        release_buffers();
+        return nullptr;
+    }
+    m_read_idx = len;
+
+    HTTP_CODE ret = process_read();
+    if ( ret == FILE_REQUEST ) {
+        process_write( ret );
+    }
+    std::shared_ptr<FileEntry> entry = m_file;
+    unmap();
+    release_buffers();
+    return entry;
+}
+
 //初始化解析请求报文状态等相关信息，私有方法
 void HttpConn::init(){
     m_check_state = CHECK_STATE_REQUESTLINE;//初始化状态为解析请求行
@@ -167,19 +306,88 @@ void HttpConn::init(){
     m_content_length = 0;
     m_host = 0;
     m_keepAlive =  false;
-
-    // 把读缓冲区清空
-    bzero(m_read_buf, READ_BUFFER_SIZE);
+    m_range = 0;
+    m_range_count = 0;
+    m_accept_gzip = false;
+    m_accept_br = false;
+    m_content_encoding = 0;
+    m_if_none_match = 0;
+    m_asset = 0;
 
     m_start_line = 0;
     m_write_idx = 0;
+    m_out.Clear();
+    m_resident_bytes = 0;
+    m_file_size = 0;
+    m_bytes_sent = 0;
+    m_status = 0;
+    m_request_pending = false;
+    m_process_start = 0;
+    m_process_end = 0;
+
+    // 缓冲区只在用到的长度内有效，不需要清零
+    m_read_buf[0] = '\0';
+    m_real_file[0] = '\0';
+}
 
+bool HttpConn::lease_buffers() {
+    if ( !m_bufs ) {
+        m_bufs = ( ConnBuffers* )BufferPool::Instance()->Lease( sizeof( ConnBuffers ) );
+        if ( !m_bufs ) {
+            return false;
+        }
+    }
+    m_read_buf = m_bufs->read;
+    m_write_buf = m_bufs->write;
+    m_real_file = m_bufs->real_file;
+    m_ranges = m_bufs->ranges;
+    return true;
+}
 
-    bzero(m_read_buf, READ_BUFFER_SIZE);
-    bzero(m_write_buf, WRITE_BUFFER_SIZE);
-    bzero(m_real_file, FILENAME_LEN);
+void HttpConn::release_buffers() {
+    BufferPool::Instance()->Release( m_bufs, sizeof( ConnBuffers ) );
+    m_bufs = NULL;
+    m_read_buf = NULL;
+    m_write_buf = NULL;
+    m_real_file = NULL;
+    m_ranges = NULL;
+    m_out.Reset();
 }
 
+// 读完请求、开始处理、生成完响应、发送完成的时间差就是排队、处理、发送的耗时
+// 提前结束的请求还没有到达的阶段按现在结束，之后的阶段耗时为0；还没有生成响应时状态码记为499，
+// 这时write_us是最后一次解析之后等待剩余请求数据的时间
+void HttpConn::log_access() {
+    if ( !m_request_pending ) {
+        return;
+    }
+    m_request_pending = false;
+    int status = m_status ? m_status : 499;
+    AccessLog* log = AccessLog::Instance();
+    if ( !log->IsOpen() || !log->Sample( status ) ) {
+        return;
+    }
+    auto us = []( int64_t d ) { return ( uint32_t )( d > 0 ? d : 0 ); };
+    int64_t now = AccessLog::Now();
+    int64_t start = m_process_start ? m_process_start : now;
+    int64_t end = m_process_end ? m_process_end : now;
+    AccessRecord record;
+    record.addr = m_address.sin_addr.s_addr;
+    record.port = m_address.sin_port;
+    record.status = status;
+    record.method = m_url ? METHOD_NAMES[ m_method ] : "-";
+    record.bytes = m_bytes_sent;
+    record.queueUs = us( start - m_read_time );
+    record.processUs = us( end - start );
+    record.writeUs = us( now - end );
+    size_t len = 0;
+    if ( m_url ) {
+        len = strnlen( m_url, AccessRecord::URL_LEN - 1 );
+        memcpy( record.url, m_url, len );
+    }
+    record.url[ len ] = '\0';
+    log->Append( record );
+}
 
 // 解析HTTP请求，主状态机的状态
 HTTP_CODE HttpConn::process_read(){
@@ -197,7 +405,7 @@ HTTP_CODE HttpConn::process_read(){
         // 获取一行数据
         text = get_line();
         m_start_line = m_checked_idx;
-        printf( "got 1 http line: %s\n", text );
+        LOG_DEBUG("fd %d got http line: %s", m_sockfd, text);
 
 
         // 有限状态机以及转换，依次读取请求报文
@@ -214,14 +422,15 @@ HTTP_CODE HttpConn::process_read(){
                 if ( ret == BAD_REQUEST ) {
                     return BAD_REQUEST;
                 } else if ( ret == GET_REQUEST ) {
-                    return do_request();//解析具体的请求信息
+                    // 先查完整响应缓存，命中则不需要do_request
+                    return send_cached_response() ? CACHED_REQUEST : do_request();//解析具体的请求信息
                 }
                 break;
             }
             case CHECK_STATE_CONTENT: {
                 ret = parse_request_content( text );
                 if ( ret == GET_REQUEST ) {
-                    return do_request();
+                    return send_cached_response() ? CACHED_REQUEST : do_request();
                 }
                 line_status = LINE_OPEN;
                 break;
@@ -319,12 +528,54 @@ HTTP_CODE HttpConn::parse_request_headers(char *text){
         text += 5;
         text += strspn( text, " \t" );
         m_host = text;
+    } else if ( strncasecmp( text, "Range:", 6 ) == 0 ) {
+        // 处理Range头部字段  Range: bytes=0-499,1000-
+        text += 6;
+        text += strspn( text, " \t" );
+        m_range = text;
+    } else if ( strncasecmp( text, "Accept-Encoding:", 16 ) == 0 ) {
+        // 处理Accept-Encoding头部字段  Accept-Encoding: gzip, deflate, br
+        text += 16;
+        parse_accept_encoding( text );
+    } else if ( strncasecmp( text, "If-None-Match:", 14 ) == 0 ) {
+        // 处理If-None-Match头部字段  If-None-Match: "5d8c72a5edda8d6a"
+        text += 14;
+        text += strspn( text, " \t" );
+        m_if_none_match = text;
     } else {
-        printf( "oop! unknow header %s\n", text );
+        LOG_DEBUG("fd %d unknown header: %s", m_sockfd, text);
     }
     return NO_REQUEST;
 }
 
+// 解析Accept-Encoding，只关心gzip和br，q=0表示明确拒绝该编码
+void HttpConn::parse_accept_encoding( char *text ) {
+    while ( *text ) {
+        text += strspn( text, " \t," );
+        size_t len = strcspn( text, " \t;," );
+        char* name = text;
+        text += len;
+
+        // 跳过参数，检查q值
+        bool accept = true;
+        while ( *text && *text != ',' ) {
+            text += strspn( text, " \t;" );
+            if ( strncasecmp( text, "q=", 2 ) == 0 ) {
+                accept = atof( text + 2 ) > 0;
+            }
+            text += strcspn( text, ";," );
+        }
+
+        if ( len == 4 && strncasecmp( name, "gzip", 4 ) == 0 ) {
+            m_accept_gzip = accept;
+        } else if ( len == 2 && strncasecmp( name, "br", 2 ) == 0 ) {
+            m_accept_br = accept;
+        } else if ( len == 1 && name[ 0 ] == '*' ) {
+            m_accept_gzip = m_accept_br = accept;
+        }
+    }
+}
+
 // 解析HTTP请求体
 // 我们没有真正解析HTTP请求的消息体，只是判断它是否被完整的读入了
 HTTP_CODE HttpConn::parse_request_content(char *text){
@@ -367,16 +618,32 @@ LINE_STATUS HttpConn::parse_line(){
 
 // 解析获取具体的请求信息
 // 当得到一个完整、正确的HTTP请求时，我们就分析目标文件的属性，
-// 如果目标文件存在、对所有用户可读，且不是目录，则使用mmap将其
-// 映射到内存地址m_file_address处，并告诉调用者获取文件成功
+// 如果目标文件存在、对所有用户可读，且不是目录，则从文件缓存中取得它的
+// 内存映射（m_file_address），并告诉调用者获取文件成功
 HTTP_CODE HttpConn::do_request()
 {
+    if ( m_embedded ) {
+        return do_embedded_request();
+    }
+
+    // 最近确认不存在的URL直接返回404，不拼接路径也不调用stat
+    if ( NegativeCache::Instance()->Contains( m_url ) ) {
+        return NO_RESOURCE;
+    }
+
     // "doc_root：/home/cnu/WebServer-dev/resources"
-    strcpy( m_real_file, doc_root );
     int len = strlen( doc_root );
+    if ( len >= FILENAME_LEN - 1 ) {
+        return INTERNAL_ERROR;
+    }
+    strcpy( m_real_file, doc_root );
     strncpy( m_real_file + len, m_url, FILENAME_LEN - len - 1 );
+    m_real_file[ FILENAME_LEN - 1 ] = '\0';
     // 获取m_real_file文件的相关的状态信息，-1失败，0成功
     if ( stat( m_real_file, &m_file_stat ) < 0 ) {
+        if ( errno == ENOENT || errno == ENOTDIR ) {
+            NegativeCache::Instance()->Insert( m_url );
+        }
         return NO_RESOURCE;
     }
 
@@ -390,23 +657,145 @@ HTTP_CODE HttpConn::do_request()
         return BAD_REQUEST;
     }
 
-    // 以只读方式打开文件
-    int fd = open( m_real_file, O_RDONLY );
+    // 客户端支持压缩时优先发送预压缩好的兄弟文件（br优先于gzip）
+    // Range请求总是按原始内容处理，区间的含义不随是否存在预压缩文件变化
+    if ( ( m_accept_br || m_accept_gzip ) && !m_range ) {
+        find_precompressed();
+    }
 
-    // 创建内存映射
-    m_file_address = ( char* )mmap( 0, m_file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
-    close( fd );
+    // 从文件缓存中取得文件的内存映射，文件没有变化时不需要再open和mmap
+    // 发送预压缩文件时，Content-Type按原始URL的扩展名确定
+    m_file = FileCache::Instance()->Get( m_real_file, m_file_stat, m_content_encoding ? m_url : nullptr );
+    if ( !m_file ) {
+        return INTERNAL_ERROR;
+    }
+    m_file_address = m_file->addr;
+    m_file_size = m_file->size;
+
+    // 没有预压缩文件时实时压缩，压缩结果缓存在文件缓存项中，只压缩一次
+    // Range请求同样按原始内容处理，不压缩
+    if ( m_accept_gzip && !m_content_encoding && !m_range ) {
+        m_gzip = FileCache::Instance()->Gzip( m_file );
+        if ( m_gzip ) {
+            m_file_address = ( char* )m_gzip->data();
+            m_file_size = m_gzip->size();
+            m_content_encoding = "gzip";
+        }
+    }
+
+    // 解析Range，只有请求的区间会被writev发送，其余部分不会被读入内存
+    m_range_count = parse_range();
+    if ( m_range_count < 0 ) {
+        return RANGE_NOT_SATISFIABLE;
+    }
     return FILE_REQUEST;
 }
 
-// 对内存映射区执行munmap操作
-// 释放资源
-void HttpConn::unmap() {
-    if( m_file_address )
-    {
-        munmap( m_file_address, m_file_stat.st_size );
-        m_file_address = 0;
+// 查找预压缩文件 index.html.br / index.html.gz
+// 预压缩文件比原文件旧时认为已经过期，不使用
+bool HttpConn::find_precompressed() {
+    const struct {
+        const char* suffix;
+        const char* encoding;
+        bool accepted;
+    } variants[] = { { ".br", "br", m_accept_br }, { ".gz", "gzip", m_accept_gzip } };
+
+    size_t len = strlen( m_real_file );
+    if ( len + 4 > FILENAME_LEN ) {
+        return false;
+    }
+    for ( const auto& v : variants ) {
+        if ( !v.accepted ) {
+            continue;
+        }
+        struct stat st;
+        strcpy( m_real_file + len, v.suffix );
+        if ( stat( m_real_file, &st ) == 0 && S_ISREG( st.st_mode ) && ( st.st_mode & S_IROTH )
+                && st.st_mtime >= m_file_stat.st_mtime ) {
+            m_file_stat = st;
+            m_content_encoding = v.encoding;
+            return true;
+        }
+    }
+    m_real_file[ len ] = '\0';
+    return false;
+}
+
+// 解析Range请求头，结果保存在m_ranges中
+// 返回值：0 没有Range或者格式不支持，按整个文件响应
+//        -1 所有区间都超出文件范围，响应416
+//        >0 可满足的区间数量
+int HttpConn::parse_range() {
+    if ( !m_range || strncasecmp( m_range, "bytes=", 6 ) != 0 ) {
+        return 0;
+    }
+    off_t size = m_file_size;
+    int count = 0;
+    int specs = 0;
+    char* p = m_range + 6;
+    while ( *p ) {
+        p += strspn( p, " \t" );
+        off_t start = -1, end = -1;
+        if ( *p == '-' ) {
+            // 后缀区间 -500 : 最后500个字节
+            ++p;
+            if ( *p < '0' || *p > '9' ) {
+                return 0;
+            }
+            off_t suffix = strtoll( p, &p, 10 );
+            if ( suffix > 0 && size > 0 ) {
+                start = suffix < size ? size - suffix : 0;
+                end = size - 1;
+            }
+        } else if ( *p >= '0' && *p <= '9' ) {
+            start = strtoll( p, &p, 10 );
+            if ( *p++ != '-' ) {
+                return 0;
+            }
+            if ( *p >= '0' && *p <= '9' ) {
+                end = strtoll( p, &p, 10 );
+                if ( end < start ) {
+                    return 0;
+                }
+            }
+            if ( start >= size ) {
+                start = -1; // 不可满足的区间
+            } else if ( end < 0 || end >= size ) {
+                end = size - 1;
+            }
+        } else {
+            return 0;
+        }
+
+        // 区间过多时忽略Range，防止构造大量小区间
+        if ( ++specs > MAX_RANGES ) {
+            return 0;
+        }
+        if ( start >= 0 ) {
+            m_ranges[ count ].start = start;
+            m_ranges[ count ].end = end;
+            count++;
+        }
+
+        p += strspn( p, " \t" );
+        if ( *p == ',' ) {
+            ++p;
+        } else if ( *p != '\0' ) {
+            return 0;
+        }
+    }
+    if ( specs == 0 ) {
+        return 0;
     }
+    return count > 0 ? count : -1;
+}
+
+// 释放对文件缓存项的引用，缓存项被淘汰且没有连接使用时才会munmap
+void HttpConn::unmap() {
+    m_file.reset();
+    m_gzip.reset();
+    m_cached.reset();
+    m_file_address = 0;
 }
 
 
@@ -418,33 +807,43 @@ void HttpConn::process() {
     // 有限状态机：按照\n切换不同的状态，解析请求行、请求头部、请求空行、请求体；
     // 不同的状态执行不同的业务逻辑
 
+    m_process_start = AccessLog::Now();
     // 服务器处理HTTP请求的可能结果，报文解析的结果
     HTTP_CODE read_ret = process_read();
 
+    // 生成响应后，将该通信的socketfd事件改为EPOLLOUT
+    // 主线程中epoll监听到此事件就把响应报文写给客户端
+    int ev = EPOLLOUT;
     if(read_ret == NO_REQUEST) {
         // NO_REQUEST: 请求不完整，需要继续读取客户数据
-        modfd(m_epollfd, m_sockfd, EPOLLIN);
-        return;//表示此函数的结束
-    }
-
-    // 生成响应
-    bool write_ret = process_write( read_ret );
-    if ( !write_ret ) {
+        ev = EPOLLIN;
+    } else if(read_ret == CACHED_REQUEST) {
+        // 命中完整响应缓存，iovec已经指向缓存的响应，直接等待发送
+        m_status = 200;
+    } else if ( !process_write( read_ret ) ) {
+        // 这一轮属于工作线程，可以直接关闭；fd已经关闭，不再注册事件
         close_conn();
+        ev = 0;
     }
+    m_process_end = AccessLog::Now();
 
-    // 生成响应后，将该通信的socketfd事件改为EPOLLOUT
-    // 主线程中epoll监听到此事件就把响应报文写给客户端
-    modfd( m_epollfd, m_sockfd, EPOLLOUT);
-
-
+    if ( ev ) {
+        modfd( m_epollfd, m_sockfd, ev );
+    }
+    // 重新注册事件之后不再访问连接的其它状态，最后结束任务
+    end_task();
 }
 
 
 // 将新的客户数据初始化，放到数组中
-void HttpConn::init(int sockfd, const sockaddr_in &addr){
+bool HttpConn::init(int sockfd, const sockaddr_in &addr){
+    if ( !lease_buffers() ) {
+        return false;
+    }
     m_sockfd = sockfd;
     m_address = addr;
+    m_prefetch.conn = this;
+    ++m_generation;
 
     // 设置端口复用
     int reuse{1};
@@ -452,119 +851,353 @@ void HttpConn::init(int sockfd, const sockaddr_in &addr){
 
     // 添加到epoll对象中
     addfd(m_epollfd, sockfd, true);
-    m_user_count++;// 总用户数加1
+    m_user_count.Add();// 总用户数加1
 
     //初始化解析请求报文状态等相关信息
     init();
+    return true;
 }
 
 
 // 关闭一个客户端连接
 void HttpConn::close_conn() {
     if(m_sockfd != -1) {
+        // 客户端中止、发送失败、超时关闭的请求也要记录
+        log_access();
         removefd(m_epollfd, m_sockfd);
         m_sockfd = -1;
-        m_user_count--;
+        m_user_count.Sub();
+        // 关闭后不再占用文件缓存项和缓冲区
+        unmap();
+        release_buffers();
     }
 }
 
 
-// 往写缓冲中写入待发送的数据
-bool HttpConn::add_response( const char* format, ... ) {
-    if( m_write_idx >= WRITE_BUFFER_SIZE ) {
-        return false;
-    }
-    va_list arg_list;
-    va_start( arg_list, format );
-    int len = vsnprintf( m_write_buf + m_write_idx, WRITE_BUFFER_SIZE - 1 - m_write_idx, format, arg_list );
-    if( len >= ( WRITE_BUFFER_SIZE - 1 - m_write_idx ) ) {
-        return false;
-    }
-    m_write_idx += len;
-    va_end( arg_list );
-    return true;
+// 往写缓冲中写入待发送的数据，空间不足返回false
+bool HttpConn::add_raw( std::string_view data ) {
+    return httpheader::Append( m_write_buf, WRITE_BUFFER_SIZE, m_write_idx, data );
 }
 
-bool HttpConn::add_status_line( int status, const char* title ) {
-    return add_response( "%s %d %s\r\n", "HTTP/1.1", status, title );
+bool HttpConn::add_uint( uint64_t value ) {
+    return httpheader::AppendUInt( m_write_buf, WRITE_BUFFER_SIZE, m_write_idx, value );
 }
 
-bool HttpConn::add_headers(int content_len) {
-    return add_content_length(content_len) & add_content_type() &
-        add_linger() & add_blank_line();
+bool HttpConn::add_status_line( int status ) {
+    m_status = status;
+    return add_raw( httpheader::StatusLine( status ) );
 }
 
-bool HttpConn::add_content_length(int content_len) {
-    return add_response( "Content-Length: %d\r\n", content_len );
+bool HttpConn::add_headers(size_t content_len) {
+    return add_common_headers() && add_content_length(content_len) &&
+        add_raw( httpheader::CONTENT_TYPE_HTML ) && add_blank_line();
 }
 
-bool HttpConn::add_linger()
+bool HttpConn::add_content_length(size_t content_len) {
+    return add_raw( httpheader::CONTENT_LENGTH ) && add_uint( content_len )
+        && add_raw( httpheader::CRLF );
+}
+
+bool HttpConn::add_common_headers()
 {
-    return add_response( "Connection: %s\r\n", ( m_keepAlive == true ) ? "keep-alive" : "close" );
+    return add_raw( CommonHeaders::Get( m_keepAlive ) );
 }
 
 bool HttpConn::add_blank_line()
 {
-    return add_response( "%s", "\r\n" );
+    return add_raw( httpheader::CRLF );
 }
 
-bool HttpConn::add_content( const char* content )
+bool HttpConn::add_content( std::string_view content )
 {
-    return add_response( "%s", content );
+    return add_raw( content );
 }
 
+// 文件的Content-Type行在文件缓存项建立时就已经确定
 bool HttpConn::add_content_type() {
-    return add_response("Content-Type:%s\r\n", "text/html");
+    return add_raw( m_file->mime->line );
+}
+
+bool HttpConn::add_accept_ranges() {
+    return add_raw( httpheader::ACCEPT_RANGES );
+}
+
+bool HttpConn::add_content_range( off_t start, off_t end ) {
+    return add_raw( httpheader::CONTENT_RANGE ) && add_uint( start ) && add_raw( "-" )
+        && add_uint( end ) && add_raw( "/" ) && add_uint( m_file_size ) && add_raw( httpheader::CRLF );
+}
+
+// 压缩的响应需要标明编码；可压缩类型的同一URL可能返回不同编码，需要告诉缓存按Accept-Encoding区分
+bool HttpConn::add_content_encoding() {
+    if ( m_content_encoding && !( add_raw( httpheader::CONTENT_ENCODING )
+            && add_raw( m_content_encoding ) && add_raw( httpheader::CRLF ) ) ) {
+        return false;
+    }
+    if ( m_content_encoding || m_file->mime->compressible ) {
+        return add_raw( httpheader::VARY_ENCODING );
+    }
+    return true;
+}
+
+// 填充206响应
+// 单区间直接发送文件的一段；多区间按multipart/byteranges格式，
+// 每一段的分段头写在m_write_buf中，文件数据直接指向mmap的内存，不做拷贝
+bool HttpConn::add_byte_ranges() {
+    if ( m_range_count == 1 ) {
+        const ByteRange& r = m_ranges[ 0 ];
+        off_t len = r.end - r.start + 1;
+        if ( !( add_status_line( 206 ) && add_common_headers() && add_content_length( len )
+                && add_content_type() && add_content_range( r.start, r.end )
+                && add_content_encoding() && add_accept_ranges() && add_blank_line() ) ) {
+            return false;
+        }
+        m_out.Append( m_write_buf, m_write_idx );
+        append_body( m_file_address + r.start, len );
+        return true;
+    }
+
+    // 20位十进制的分隔符
+    char boundary[ 20 ];
+    unsigned long seq = ++range_boundary_seq;
+    memset( boundary, '0', sizeof( boundary ) );
+    httpheader::FormatUInt( boundary + sizeof( boundary ) - httpheader::CountDigits( seq ), seq );
+    std::string_view bound( boundary, sizeof( boundary ) );
+
+    // 先把各段的分段头写到临时缓冲区，以便计算Content-Length
+    char parts[ WRITE_BUFFER_SIZE ];
+    size_t part_end[ MAX_RANGES + 1 ];
+    size_t used = 0;
+    off_t body_len = 0;
+    for ( int i = 0; i <= m_range_count; ++i ) {
+        bool ok = httpheader::Append( parts, sizeof( parts ), used, "\r\n--" )
+            && httpheader::Append( parts, sizeof( parts ), used, bound );
+        if ( i < m_range_count ) {
+            const ByteRange& r = m_ranges[ i ];
+            ok = ok && httpheader::Append( parts, sizeof( parts ), used, httpheader::CRLF )
+                && httpheader::Append( parts, sizeof( parts ), used, m_file->mime->line )
+                && httpheader::Append( parts, sizeof( parts ), used, httpheader::CONTENT_RANGE )
+                && httpheader::AppendUInt( parts, sizeof( parts ), used, r.start )
+                && httpheader::Append( parts, sizeof( parts ), used, "-" )
+                && httpheader::AppendUInt( parts, sizeof( parts ), used, r.end )
+                && httpheader::Append( parts, sizeof( parts ), used, "/" )
+                && httpheader::AppendUInt( parts, sizeof( parts ), used, m_file_size )
+                && httpheader::Append( parts, sizeof( parts ), used, "\r\n\r\n" );
+            body_len += r.end - r.start + 1;
+        } else {
+            ok = ok && httpheader::Append( parts, sizeof( parts ), used, "--\r\n" );
+        }
+        if ( !ok ) {
+            return false;
+        }
+        part_end[ i ] = used;
+    }
+    body_len += used;
+
+    if ( !( add_status_line( 206 ) && add_common_headers() && add_content_length( body_len )
+            && add_raw( httpheader::CONTENT_TYPE_MULTIPART ) && add_raw( bound ) && add_raw( httpheader::CRLF )
+            && add_content_encoding() && add_accept_ranges() && add_blank_line() ) ) {
+        return false;
+    }
+    char* head = m_write_buf + m_write_idx;
+    if ( !add_raw( std::string_view( parts, used ) ) ) {
+        return false;
+    }
+
+    // 响应头与第一个分段头连续，放在同一个片段中
+    m_out.Append( m_write_buf, head - m_write_buf + part_end[ 0 ] );
+    for ( int i = 0; i < m_range_count; ++i ) {
+        const ByteRange& r = m_ranges[ i ];
+        append_body( m_file_address + r.start, r.end - r.start + 1 );
+        m_out.Append( head + part_end[ i ], part_end[ i + 1 ] - part_end[ i ] );
+    }
+    return true;
 }
 
 
+// 完整响应缓存的键：URL + 客户端接受的编码
+// 同样的URL和Accept-Encoding一定会选中同样的文件和编码
+size_t HttpConn::response_cache_key( char* key, size_t cap ) {
+    size_t len = strlen( m_url );
+    if ( len + 2 > cap ) {
+        return 0;
+    }
+    memcpy( key, m_url, len );
+    key[ len++ ] = '\0';
+    key[ len++ ] = char( '0' + ( m_accept_br ? 2 : 0 ) + ( m_accept_gzip ? 1 : 0 ) );
+    return len;
+}
+
+// 查找完整响应缓存，命中时直接设置好三段iovec：缓存的状态行、当前的公共头部、缓存的其余部分
+bool HttpConn::send_cached_response() {
+    ResponseCache* cache = ResponseCache::Instance();
+    if ( m_range || m_method != GET || !cache->Enabled() ) {
+        return false;
+    }
+    char key[ FILENAME_LEN ];
+    size_t len = response_cache_key( key, sizeof( key ) );
+    if ( len == 0 ) {
+        return false;
+    }
+    m_cached = cache->Get( std::string_view( key, len ) );
+    if ( !m_cached ) {
+        return false;
+    }
+
+    add_common_headers();
+    const std::string& data = m_cached->data;
+    m_out.Append( data.data(), m_cached->statusLen, m_cached );
+    m_out.Append( m_write_buf, m_write_idx );
+    m_out.Append( data.data() + m_cached->statusLen, data.size() - m_cached->statusLen, m_cached );
+    return true;
+}
+
+// 把刚生成的小文件响应放入完整响应缓存，去掉其中的公共头部（每秒都在变）
+// common_begin/common_end：公共头部在m_write_buf中的位置
+void HttpConn::store_cached_response( size_t common_begin, size_t common_end ) {
+    ResponseCache* cache = ResponseCache::Instance();
+    if ( m_range || !cache->Enabled() || ( size_t )m_file_size > cache->MaxObjectSize() ) {
+        return;
+    }
+    char key[ FILENAME_LEN ];
+    size_t len = response_cache_key( key, sizeof( key ) );
+    if ( len == 0 ) {
+        return;
+    }
+
+    std::shared_ptr<CachedResponse> resp = std::make_shared<CachedResponse>();
+    resp->key.assign( key, len );
+    resp->data.reserve( m_write_idx - ( common_end - common_begin ) + m_file_size );
+    resp->data.append( m_write_buf, common_begin );
+    resp->data.append( m_write_buf + common_end, m_write_idx - common_end );
+    resp->data.append( m_file_address, m_file_size );
+    resp->statusLen = common_begin;
+    resp->path = m_real_file;
+    resp->ino = m_file_stat.st_ino;
+    resp->mtime = m_file_stat.st_mtime;
+    resp->size = m_file_stat.st_size;
+    cache->Put( std::move( resp ) );
+}
+
+// 嵌入模式：在编译进程序的资源表中查找，不访问文件系统
+// 嵌入的资源不压缩，Range请求按RFC 7233允许的方式忽略，返回整个资源
+HTTP_CODE HttpConn::do_embedded_request() {
+    m_asset = embedded::Find( m_url );
+    if ( !m_asset ) {
+        return NO_RESOURCE;
+    }
+    // 嵌入的资源不会改变，ETag匹配时只返回304
+    if ( m_if_none_match && ( strstr( m_if_none_match, m_asset->etag.data() ) || strcmp( m_if_none_match, "*" ) == 0 ) ) {
+        return NOT_MODIFIED;
+    }
+    return EMBEDDED_REQUEST;
+}
+
+// 把实体内容加入输出链：实时压缩的内容由压缩结果持有，否则在文件映射中，由文件缓存项持有
+void HttpConn::append_body( const char* data, size_t len ) {
+    if ( m_gzip ) {
+        m_out.Append( data, len, m_gzip );
+    } else {
+        m_out.Append( data, len, m_file, true );
+    }
+}
+
 // 根据服务器处理HTTP请求的结果，决定返回给客户端的内容
 bool HttpConn::process_write(HTTP_CODE ret) {
     switch (ret)
     {
         case INTERNAL_ERROR:
-            add_status_line( 500, error_500_title );
-            add_headers( strlen( error_500_form ) );
+            add_status_line( 500 );
+            add_headers( error_500_form.size() );
             if ( ! add_content( error_500_form ) ) {
                 return false;
             }
             break;
         case BAD_REQUEST:
-            add_status_line( 400, error_400_title );
-            add_headers( strlen( error_400_form ) );
+            add_status_line( 400 );
+            add_headers( error_400_form.size() );
             if ( ! add_content( error_400_form ) ) {
                 return false;
             }
             break;
         case NO_RESOURCE:
-            add_status_line( 404, error_404_title );
-            add_headers( strlen( error_404_form ) );
-            if ( ! add_content( error_404_form ) ) {
+            // 状态行和其余部分都是常量，只有公共头部需要拷贝到写缓冲区
+            if ( ! add_common_headers() ) {
                 return false;
             }
-            break;
+            m_status = 404;
+            m_out.Append( httpheader::STATUS_404 );
+            m_out.Append( m_write_buf, m_write_idx );
+            m_out.Append( error_404_tail );
+            return true;
         case FORBIDDEN_REQUEST:
-            add_status_line( 403, error_403_title );
-            add_headers(strlen( error_403_form));
+            add_status_line( 403 );
+            add_headers( error_403_form.size() );
             if ( ! add_content( error_403_form ) ) {
                 return false;
             }
             break;
+        case RANGE_NOT_SATISFIABLE:
+            add_status_line( 416 );
+            add_raw( httpheader::CONTENT_RANGE );
+            add_raw( "*/" );
+            add_uint( m_file_size );
+            add_raw( httpheader::CRLF );
+            add_headers( error_416_form.size() );
+            if ( ! add_content( error_416_form ) ) {
+                return false;
+            }
+            break;
         case FILE_REQUEST:
-            add_status_line(200, ok_200_title );
-            add_headers(m_file_stat.st_size);
-            m_iv[ 0 ].iov_base = m_write_buf;
-            m_iv[ 0 ].iov_len = m_write_idx;
-            m_iv[ 1 ].iov_base = m_file_address;
-            m_iv[ 1 ].iov_len = m_file_stat.st_size;
-            m_iv_count = 2;
+            if ( m_range_count > 0 ) {
+                if ( add_byte_ranges() ) {
+                    return true;
+                }
+                // 分段头放不下写缓冲区时，退化为返回整个文件
+                m_write_idx = 0;
+            }
+        {
+            add_status_line( 200 );
+            size_t common_begin = m_write_idx;
+            add_common_headers();
+            size_t common_end = m_write_idx;
+            add_content_length( m_file_size );
+            add_content_type();
+            add_content_encoding();
+            add_accept_ranges();
+            if ( !add_blank_line() ) {
+                return false;
+            }
+            store_cached_response( common_begin, common_end );
+            m_out.Append( m_write_buf, m_write_idx );
+            append_body( m_file_address, m_file_size );
+            return true;
+        }
+        case EMBEDDED_REQUEST:
+        case NOT_MODIFIED:
+        {
+            // 只有公共头部需要生成，其余都是编译时准备好的常量
+            if ( ! add_common_headers() ) {
+                return false;
+            }
+            m_status = ret == NOT_MODIFIED ? 304 : 200;
+            m_out.Append( httpheader::StatusLine( m_status ) );
+            m_out.Append( m_write_buf, m_write_idx );
+            m_out.Append( m_asset->etagLine );
+            // 304没有消息体，也不带Content-Length和Content-Type
+            if ( ret == EMBEDDED_REQUEST ) {
+                m_out.Append( m_asset->lengthLine );
+                m_out.Append( m_asset->mime->line );
+            }
+            m_out.Append( httpheader::CRLF );
+            if ( ret == EMBEDDED_REQUEST ) {
+                m_out.Append( m_asset->body );
+            }
             return true;
+        }
         default:
             return false;
     }
 
-    m_iv[ 0 ].iov_base = m_write_buf;
-    m_iv[ 0 ].iov_len = m_write_idx;
-    m_iv_count = 1;
+    m_out.Append( m_write_buf, m_write_idx );
     return true;
 }
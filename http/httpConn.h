@@ -18,15 +18,31 @@
 #include <sys/epoll.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
-#include <stdarg.h>
 #include <sys/uio.h>
 #include <cassert>
+#include <atomic>
+#include <memory>
+#include <string>
+#include "../cache/filecache.h"
+#include "../cache/responsecache.h"
+#include "../cache/negativecache.h"
+#include "httpheader.h"
+#include "commonheaders.h"
+#include "embedded.h"
+#include "../pool/bufferpool.h"
+#include "../pool/counter.h"
+#include "../buffer/outputchain.h"
 
 class TimerNode; // 前向声明
+class HttpConn;
+template <typename T>
+class ThreadPool;
 
 #define READ_BUFFER_SIZE 2048  // 读缓冲区的大小
 #define WRITE_BUFFER_SIZE 1024 // 写缓冲区的大小
 #define FILENAME_LEN 200       // 文件名的最大长度
+#define MAX_RANGES 8           // 一次请求最多支持的Range区间数，超过则忽略Range返回整个文件
+#define PREFETCH_WINDOW (4 * 1024 * 1024) // 每次检查/预读的文件数据量
 
 // 有限状态机的枚举状态:
 // HTTP请求方法，本项目只支持GET，后面自己实现POST
@@ -75,6 +91,8 @@ enum LINE_STATUS
         FILE_REQUEST        :   文件请求,获取文件成功
         INTERNAL_ERROR      :   表示服务器内部错误
         CLOSED_CONNECTION   :   表示客户端已经关闭连接了
+        RANGE_NOT_SATISFIABLE : 请求的Range区间都超出了文件范围
+        CACHED_REQUEST      :   命中完整响应缓存，响应已经准备好
     */
 enum HTTP_CODE
 {
@@ -85,23 +103,52 @@ enum HTTP_CODE
     FORBIDDEN_REQUEST,
     FILE_REQUEST,
     INTERNAL_ERROR,
-    CLOSED_CONNECTION
+    CLOSED_CONNECTION,
+    RANGE_NOT_SATISFIABLE,
+    CACHED_REQUEST,
+    EMBEDDED_REQUEST,
+    NOT_MODIFIED
 };
 
+// Range请求中的一个字节区间，[start, end]均为闭区间
+struct ByteRange
+{
+    off_t start;
+    off_t end;
+};
+
+// 冷文件预读任务，由I/O线程池执行，完成后重新注册EPOLLOUT
+struct PrefetchTask
+{
+    HttpConn *conn;
+    unsigned generation; // 提交时连接的代数，连接已经换成新的客户端时不再注册事件
+    void process();
+};
+
+// 连接处理请求期间从缓冲区池借用的缓冲区和只在请求期间使用的状态
+// keep-alive连接在两个请求之间归还这部分内存，只保留fd、定时器、地址等少量状态
+struct ConnBuffers
+{
+    char read[READ_BUFFER_SIZE];
+    char write[WRITE_BUFFER_SIZE];
+    char real_file[FILENAME_LEN];
+    ByteRange ranges[MAX_RANGES];
+};
+static_assert(sizeof(ConnBuffers) <= BufferPool::MAX_SIZE, "ConnBuffers must fit in a buffer pool class");
+
 class HttpConn
 {
 public:
-    HttpConn() {}
-
-    ~HttpConn() {}
+    HttpConn() : timer(NULL), m_sockfd(-1), m_bufs(NULL), m_read_buf(NULL), m_write_buf(NULL),
+                 m_generation(0), m_in_flight(0), m_ranges(NULL), m_real_file(NULL) {}
 
-    TimerNode *timer; // 定时器
+    ~HttpConn() { release_buffers(); }
 
     // 处理客户端请求，解析请求报文，由线程池中的工作线程调用
     void process();
 
-    // 将新的客户数据初始化，放到数组中
-    void init(int sockfd, const sockaddr_in &addr);
+    // 初始化新的客户连接并借用缓冲区，缓冲区不足时返回false
+    bool init(int sockfd, const sockaddr_in &addr);
 
     // 关闭连接
     void close_conn();
@@ -132,52 +179,134 @@ public:
     // 所有的socket上的事件都被注册到同一个epoll对象中
     static int m_epollfd;
 
-    // 用户数量
-    static int m_user_count;
+    // 用户数量，主线程和工作线程都会修改，按线程分片计数
+    static ShardedCounter m_user_count;
+
+    // 预读冷文件的I/O线程池，为空时在写线程中直接发送
+    static ThreadPool<PrefetchTask> *m_io_pool;
+
+    // 嵌入模式：只从编译进程序的资源响应，不访问文件系统
+    static bool m_embedded;
+
+    // 在I/O线程中把接下来要发送的文件数据读入内存
+    void prefetch();
+
+    // 连接交给工作线程或I/O线程之前调用begin_task，对方重新注册事件之后调用end_task
+    // in_flight期间这一轮EPOLLONESHOT属于工作线程或I/O线程，主线程的定时器不能关闭连接、归还缓冲区和文件映射
+    void begin_task() { m_in_flight.fetch_add( 1, std::memory_order_relaxed ); }
+    void end_task() { m_in_flight.fetch_sub( 1, std::memory_order_release ); }
+    bool in_flight() const { return m_in_flight.load( std::memory_order_acquire ) > 0; }
+
+    // 启动预热：不经过socket模拟一次GET请求，把文件放入文件缓存和完整响应缓存
+    // accept_encoding：模拟请求的Accept-Encoding头，nullptr表示不带
+    // 返回这次请求用到的文件缓存项，没有用到文件时返回nullptr
+    std::shared_ptr<FileEntry> warm(const char *url, const char *accept_encoding);
 
     // 这一组函数被process_write调用以填充HTTP响应
-    void unmap(); // 对内存映射区执行munmap操作
-    bool add_response(const char *format, ...);
-    bool add_content(const char *content);
+    void unmap(); // 释放对文件缓存项的引用
+    bool add_raw(std::string_view data); // 直接拷贝到写缓冲区
+    bool add_uint(uint64_t value);       // 写入十进制整数
+    bool add_content(std::string_view content);
     bool add_content_type();
-    bool add_status_line(int status, const char *title); // title:状态码的描述
-    bool add_headers(int content_length);
-    bool add_content_length(int content_length);
-    bool add_linger();
+    bool add_status_line(int status); // 状态行是预先生成好的常量
+    bool add_headers(size_t content_length);
+    bool add_content_length(size_t content_length);
+    bool add_common_headers(); // Server、Date、Connection等公共头部
     bool add_blank_line(); // 添加空行
+    bool add_accept_ranges();
+    bool add_content_range(off_t start, off_t end);
+    bool add_content_encoding(); // Content-Encoding与Vary
+    bool add_byte_ranges(); // 填充206响应（单区间或multipart/byteranges）
+    void append_body(const char *data, size_t len); // 把实体内容加入输出链，不拷贝
+
+private:
+    int parse_range(); // 解析Range头，返回区间数，0表示忽略，-1表示无法满足
+    void parse_accept_encoding(char *text); // 解析Accept-Encoding头
+    bool find_precompressed(); // 查找可用的.br/.gz预压缩文件，找到则替换m_real_file
+    HTTP_CODE do_embedded_request(); // 嵌入模式下查找请求的资源
+
+    size_t response_cache_key(char *key, size_t cap); // 生成完整响应缓存的键，返回长度，0表示不能缓存
+    bool send_cached_response(); // 命中完整响应缓存时直接准备好待发送的数据
+    void store_cached_response(size_t common_begin, size_t common_end); // 缓存小文件的完整响应
+
+    void init(); // 初始化解析请求报文状态等相关信息
+    bool lease_buffers();   // 从缓冲区池借用缓冲区，已经借用时直接返回
+    void release_buffers(); // 归还缓冲区，连接进入空闲状态
+    void log_access();      // 一次请求结束（发送完成或连接被关闭）时写访问日志，每个请求只记录一次
+
+    char *get_line()
+    { // 获得一行数据
+        return m_read_buf + m_start_line;
+    }
+
+    // 遍历接下来PREFETCH_WINDOW字节内属于文件映射的数据，返回窗口内的总字节数
+    template <typename F>
+    size_t for_each_file_window(F fn);
+    bool check_resident(); // 检查接下来要发送的文件数据是否在page cache中，不在则提交预读
+
+    // 成员按写入它们的线程分组，每组从新的缓存行开始：
+    // 主线程在accept、读、写和定时器中修改第一组，主线程和预读、工作线程都会修改第二组，
+    // 工作线程解析请求、生成响应时修改第三组；m_out由工作线程生成，主线程只在工作线程结束后发送，
+    // 所以放在第三组。不同线程写同一个连接的不同字段、或相邻连接的字段时不会争用同一个缓存行
+
+public:
+    // ---------- 主线程：连接、读取、发送 ----------
+    alignas(CACHELINE_SIZE) TimerNode *timer; // 定时器
 
 private:
     int m_sockfd;                      // 该http连接的socket
     sockaddr_in m_address;             // 客户端通信的socke地址
-    char m_read_buf[READ_BUFFER_SIZE]; // 读缓存区
+    ConnBuffers *m_bufs;               // 借用的缓冲区，没有借用时为NULL
+    char *m_read_buf;                  // 读缓存区，指向m_bufs->read
+    char *m_write_buf;                 // 写缓冲区，指向m_bufs->write
     int m_read_idx;                    // 标识读缓冲区中以及读入的客户端数据的最后一个字节的下一个位置
-    int m_checked_idx;                 // 当前正在解析的字符在缓冲区的位置
+    PrefetchTask m_prefetch;           // 预读任务
+    unsigned m_generation;             // 每接受一个新的客户端加一
+    int64_t m_read_time;               // 读完请求的时间，AccessLog::Now()
+    uint64_t m_bytes_sent;             // 这次响应已经发送的字节数
+    bool m_request_pending;            // 读到了请求数据，还没有写访问日志
+
+    // ---------- 多个线程：任务计数、预读结果 ----------
+    alignas(CACHELINE_SIZE) std::atomic<int> m_in_flight; // 交给其它线程还没有结束的任务数
+    size_t m_resident_bytes;           // 接下来已确认在内存中、可以直接发送的字节数，主线程和预读任务修改
+
+    // ---------- 工作线程：解析请求、生成响应 ----------
+    alignas(CACHELINE_SIZE) int m_checked_idx; // 当前正在解析的字符在缓冲区的位置
     int m_start_line;                  // 当前正在解析的行的起始位置
     CHECK_STATE m_check_state;         // 主状态机当前状态
     int m_content_length;              // HTTP请求的消息总长度
+    int64_t m_process_start;           // 工作线程开始处理的时间
+    int64_t m_process_end;             // 响应生成完的时间
+    int m_status;                      // 响应状态码，0表示还没有生成响应
+    OutputChain m_out;                 // 待发送的响应，工作线程生成，主线程用writev发送
 
     char *m_url;      // 请求目标文件的文件名
     char *m_version;  // 协议版本，此项目只支持HTTP1.1
     METHOD m_method;  // 请求方法，GET
-    char *m_host;     // 主机名
     bool m_keepAlive; // HTTP请求是否保存连接
-
-    void init(); // 初始化解析请求报文状态等相关信息
-
-    // 客户请求的目标文件的完整路径，其内容等于 doc_root + m_url, doc_root是网站根目录
-    char m_real_file[FILENAME_LEN];
-
-    char *get_line()
-    { // 获得一行数据
-        return m_read_buf + m_start_line;
-    }
-
-    char m_write_buf[WRITE_BUFFER_SIZE]; // 写缓冲区
-    int m_write_idx;                     // 写缓冲区中待发送的字节数
-    char *m_file_address;                // 客户请求的目标文件被mmap到内存中的起始位置
-    struct stat m_file_stat;             // 目标文件的状态。通过它我们可以判断文件是否存在、是否为目录、是否可读，并获取文件大小等信息
-    struct iovec m_iv[2];                // 我们将采用writev来执行写操作，所以定义下面两个成员，其中m_iv_count表示被写内存块的数量。
-    int m_iv_count;
+    bool m_accept_gzip; // 客户端是否接受gzip编码
+    bool m_accept_br;   // 客户端是否接受brotli编码
+    char *m_host;     // 主机名
+    char *m_range;    // Range请求头的内容，没有则为0
+    const char *m_content_encoding; // 响应使用的预压缩编码，0表示未压缩
+    char *m_if_none_match;          // If-None-Match请求头的内容，没有则为0
+    const EmbeddedAsset *m_asset;   // 嵌入模式下请求的资源
+
+    ByteRange *m_ranges;            // 解析出的可满足的区间，指向m_bufs->ranges
+    int m_range_count;              // 区间数量，0表示返回整个文件
+
+    // 客户请求的目标文件的完整路径，其内容等于 doc_root + m_url, doc_root是网站根目录，指向m_bufs->real_file
+    char *m_real_file;
+    size_t m_write_idx;                  // 写缓冲区中待发送的字节数
+    char *m_file_address;                // 要发送的实体内容的起始位置（文件映射或压缩后的内容）
+    off_t m_file_size;                   // 要发送的实体内容的长度
+    std::shared_ptr<FileEntry> m_file;   // 文件缓存项，发送期间持有引用，保证映射不被释放
+    std::shared_ptr<const std::string> m_gzip; // 实时压缩后的内容
+    std::shared_ptr<const CachedResponse> m_cached; // 命中的完整响应缓存
+
+    // ---------- 只在do_request中使用 ----------
+    // 目标文件的状态。通过它我们可以判断文件是否存在、是否为目录、是否可读，并获取文件大小等信息
+    alignas(CACHELINE_SIZE) struct stat m_file_stat;
 };
 
 #endif
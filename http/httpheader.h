@@ -0,0 +1,125 @@
+// 响应头的快速拼接
+// 状态行和常用头部都是编译期常量，整数用查表转换，拼接一个响应头只需要几次memcpy
+
+#ifndef HTTPHEADER_H
+#define HTTPHEADER_H
+
+#include <string.h>
+#include <stdint.h>
+#include <string_view>
+
+namespace httpheader
+{
+    constexpr std::string_view CRLF = "\r\n";
+
+    // 状态行
+    constexpr std::string_view STATUS_200 = "HTTP/1.1 200 OK\r\n";
+    constexpr std::string_view STATUS_206 = "HTTP/1.1 206 Partial Content\r\n";
+    constexpr std::string_view STATUS_304 = "HTTP/1.1 304 Not Modified\r\n";
+    constexpr std::string_view STATUS_400 = "HTTP/1.1 400 Bad Request\r\n";
+    constexpr std::string_view STATUS_403 = "HTTP/1.1 403 Forbidden\r\n";
+    constexpr std::string_view STATUS_404 = "HTTP/1.1 404 Not Found\r\n";
+    constexpr std::string_view STATUS_416 = "HTTP/1.1 416 Range Not Satisfiable\r\n";
+    constexpr std::string_view STATUS_500 = "HTTP/1.1 500 Internal Error\r\n";
+
+    constexpr std::string_view StatusLine(int status)
+    {
+        switch (status)
+        {
+        case 200: return STATUS_200;
+        case 206: return STATUS_206;
+        case 304: return STATUS_304;
+        case 400: return STATUS_400;
+        case 403: return STATUS_403;
+        case 404: return STATUS_404;
+        case 416: return STATUS_416;
+        default:  return STATUS_500;
+        }
+    }
+
+    // 常用头部
+    constexpr std::string_view CONTENT_LENGTH = "Content-Length: ";
+    constexpr std::string_view CONTENT_TYPE_HTML = "Content-Type: text/html; charset=utf-8\r\n"; // 错误页面
+    constexpr std::string_view CONTENT_TYPE_MULTIPART = "Content-Type: multipart/byteranges; boundary=";
+    constexpr std::string_view CONTENT_RANGE = "Content-Range: bytes ";
+    constexpr std::string_view CONTENT_ENCODING = "Content-Encoding: ";
+    constexpr std::string_view VARY_ENCODING = "Vary: Accept-Encoding\r\n";
+    constexpr std::string_view ACCEPT_RANGES = "Accept-Ranges: bytes\r\n";
+
+    // 0~99的两位数字表，每次转换两位
+    constexpr char DIGITS_LUT[] =
+        "00010203040506070809"
+        "10111213141516171819"
+        "20212223242526272829"
+        "30313233343536373839"
+        "40414243444546474849"
+        "50515253545556575859"
+        "60616263646566676869"
+        "70717273747576777879"
+        "80818283848586878889"
+        "90919293949596979899";
+
+    // 十进制位数
+    inline int CountDigits(uint64_t v)
+    {
+        int n = 1;
+        for (;;)
+        {
+            if (v < 10) return n;
+            if (v < 100) return n + 1;
+            if (v < 1000) return n + 2;
+            if (v < 10000) return n + 3;
+            v /= 10000;
+            n += 4;
+        }
+    }
+
+    // 把v写到out处，返回写入的字节数，out至少要有20个字节的空间
+    inline int FormatUInt(char *out, uint64_t v)
+    {
+        const int len = CountDigits(v);
+        char *p = out + len;
+        while (v >= 100)
+        {
+            const unsigned i = (v % 100) * 2;
+            v /= 100;
+            *--p = DIGITS_LUT[i + 1];
+            *--p = DIGITS_LUT[i];
+        }
+        if (v < 10)
+        {
+            *--p = char('0' + v);
+        }
+        else
+        {
+            const unsigned i = v * 2;
+            *--p = DIGITS_LUT[i + 1];
+            *--p = DIGITS_LUT[i];
+        }
+        return len;
+    }
+
+    // 向buf[len]处追加内容，空间不足时不写入并返回false
+    inline bool Append(char *buf, size_t cap, size_t &len, std::string_view s)
+    {
+        if (len + s.size() > cap)
+        {
+            return false;
+        }
+        memcpy(buf + len, s.data(), s.size());
+        len += s.size();
+        return true;
+    }
+
+    inline bool AppendUInt(char *buf, size_t cap, size_t &len, uint64_t v)
+    {
+        if (len + 20 > cap && len + CountDigits(v) > cap)
+        {
+            return false;
+        }
+        len += FormatUInt(buf + len, v);
+        return true;
+    }
+}
+
+#endif
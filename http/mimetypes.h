@@ -0,0 +1,168 @@
+// 根据文件扩展名得到Content-Type
+// 扩展名表在编译期生成完美哈希：编译器搜索一个让所有扩展名落在不同桶中的种子，
+// 查找时只需要一次哈希和一次比较；结果是完整的"Content-Type: ...\r\n"行，可以直接拷贝进响应头
+
+#ifndef MIMETYPES_H
+#define MIMETYPES_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string_view>
+
+struct MimeType
+{
+    std::string_view ext;  // 小写扩展名，不含'.'
+    std::string_view line; // 完整的Content-Type头部行
+    bool compressible;     // 是否值得gzip压缩，图片视频等已压缩的格式为false
+};
+
+namespace mimetypes
+{
+    constexpr MimeType TABLE[] = {
+        {"html", "Content-Type: text/html; charset=utf-8\r\n", true},
+        {"htm", "Content-Type: text/html; charset=utf-8\r\n", true},
+        {"css", "Content-Type: text/css; charset=utf-8\r\n", true},
+        {"js", "Content-Type: text/javascript; charset=utf-8\r\n", true},
+        {"mjs", "Content-Type: text/javascript; charset=utf-8\r\n", true},
+        {"json", "Content-Type: application/json\r\n", true},
+        {"xml", "Content-Type: application/xml\r\n", true},
+        {"txt", "Content-Type: text/plain; charset=utf-8\r\n", true},
+        {"csv", "Content-Type: text/csv; charset=utf-8\r\n", true},
+        {"md", "Content-Type: text/markdown; charset=utf-8\r\n", true},
+        {"svg", "Content-Type: image/svg+xml\r\n", true},
+        {"wasm", "Content-Type: application/wasm\r\n", true},
+        {"ico", "Content-Type: image/x-icon\r\n", true},
+        {"jpg", "Content-Type: image/jpeg\r\n", false},
+        {"jpeg", "Content-Type: image/jpeg\r\n", false},
+        {"png", "Content-Type: image/png\r\n", false},
+        {"gif", "Content-Type: image/gif\r\n", false},
+        {"webp", "Content-Type: image/webp\r\n", false},
+        {"avif", "Content-Type: image/avif\r\n", false},
+        {"bmp", "Content-Type: image/bmp\r\n", false},
+        {"woff", "Content-Type: font/woff\r\n", false},
+        {"woff2", "Content-Type: font/woff2\r\n", false},
+        {"ttf", "Content-Type: font/ttf\r\n", true},
+        {"otf", "Content-Type: font/otf\r\n", true},
+        {"mp4", "Content-Type: video/mp4\r\n", false},
+        {"webm", "Content-Type: video/webm\r\n", false},
+        {"mp3", "Content-Type: audio/mpeg\r\n", false},
+        {"ogg", "Content-Type: audio/ogg\r\n", false},
+        {"wav", "Content-Type: audio/wav\r\n", false},
+        {"pdf", "Content-Type: application/pdf\r\n", false},
+        {"zip", "Content-Type: application/zip\r\n", false},
+        {"gz", "Content-Type: application/gzip\r\n", false},
+        {"br", "Content-Type: application/octet-stream\r\n", false},
+        {"tar", "Content-Type: application/x-tar\r\n", true},
+    };
+
+    // 未知扩展名
+    constexpr MimeType DEFAULT = {"", "Content-Type: application/octet-stream\r\n", false};
+
+    constexpr size_t COUNT = sizeof(TABLE) / sizeof(TABLE[0]);
+    constexpr size_t BUCKETS = 128; // 2的幂，取模用与运算
+    constexpr size_t MAX_EXT = 8;   // 超过这个长度的扩展名一定不在表中
+
+    constexpr char Lower(char c)
+    {
+        return (c >= 'A' && c <= 'Z') ? char(c - 'A' + 'a') : c;
+    }
+
+    // 忽略大小写的FNV-1a哈希
+    constexpr uint32_t Hash(std::string_view ext, uint32_t seed)
+    {
+        uint32_t h = 2166136261u ^ seed;
+        for (char c : ext)
+        {
+            h = (h ^ (unsigned char)Lower(c)) * 16777619u;
+        }
+        return h ^ (h >> 15);
+    }
+
+    // 编译期搜索使所有扩展名互不冲突的种子
+    constexpr uint32_t FindSeed()
+    {
+        for (uint32_t seed = 0; seed < 100000; ++seed)
+        {
+            bool used[BUCKETS] = {};
+            bool ok = true;
+            for (size_t i = 0; i < COUNT && ok; ++i)
+            {
+                size_t b = Hash(TABLE[i].ext, seed) & (BUCKETS - 1);
+                ok = !used[b];
+                used[b] = true;
+            }
+            if (ok)
+            {
+                return seed;
+            }
+        }
+        return UINT32_MAX;
+    }
+
+    constexpr uint32_t SEED = FindSeed();
+    static_assert(SEED != UINT32_MAX, "no perfect hash seed for the MIME table, enlarge BUCKETS");
+
+    struct BucketTable
+    {
+        int8_t index[BUCKETS]; // 桶 -> TABLE下标，-1表示空
+    };
+
+    constexpr BucketTable BuildBuckets()
+    {
+        BucketTable t{};
+        for (size_t b = 0; b < BUCKETS; ++b)
+        {
+            t.index[b] = -1;
+        }
+        for (size_t i = 0; i < COUNT; ++i)
+        {
+            t.index[Hash(TABLE[i].ext, SEED) & (BUCKETS - 1)] = int8_t(i);
+        }
+        return t;
+    }
+
+    constexpr BucketTable BUCKET_TABLE = BuildBuckets();
+
+    constexpr bool EqualsLower(std::string_view ext, std::string_view lower)
+    {
+        if (ext.size() != lower.size())
+        {
+            return false;
+        }
+        for (size_t i = 0; i < ext.size(); ++i)
+        {
+            if (Lower(ext[i]) != lower[i])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // 根据路径的扩展名查找类型，找不到返回DEFAULT
+    constexpr const MimeType &Lookup(std::string_view path)
+    {
+        size_t dot = path.rfind('.');
+        if (dot == std::string_view::npos || path.find('/', dot) != std::string_view::npos)
+        {
+            return DEFAULT;
+        }
+        std::string_view ext = path.substr(dot + 1);
+        if (ext.empty() || ext.size() > MAX_EXT)
+        {
+            return DEFAULT;
+        }
+        int8_t i = BUCKET_TABLE.index[Hash(ext, SEED) & (BUCKETS - 1)];
+        if (i < 0 || !EqualsLower(ext, TABLE[i].ext))
+        {
+            return DEFAULT;
+        }
+        return TABLE[i];
+    }
+
+    static_assert(Lookup("/images/image1.jpg").line == "Content-Type: image/jpeg\r\n");
+    static_assert(Lookup("/index.HTML").compressible);
+    static_assert(Lookup("/a.b/noext").line == DEFAULT.line);
+}
+
+#endif
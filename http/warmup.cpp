@@ -0,0 +1,109 @@
+#include "warmup.h"
+#include <dirent.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "httpConn.h"
+
+// 浏览器通常发送的Accept-Encoding，响应缓存按客户端支持的编码区分，
+// 预热不带编码和这一种最常见的情况
+static const char *const BROWSER_ACCEPT_ENCODING = "gzip, deflate, br";
+
+// 预压缩文件在请求原文件时被使用，原文件存在时不再单独预热
+static bool IsPrecompressedSibling(const std::string &path)
+{
+    size_t len = path.size();
+    if (len > 3 && (path.compare(len - 3, 3, ".gz") == 0 || path.compare(len - 3, 3, ".br") == 0))
+    {
+        struct stat st;
+        return stat(path.substr(0, len - 3).c_str(), &st) == 0;
+    }
+    return false;
+}
+
+// 递归遍历目录，收集所有普通文件相对于根目录的路径
+static void Walk(const std::string &root, const std::string &dir, std::vector<std::string> &urls)
+{
+    DIR *dp = opendir((root + dir).c_str());
+    if (!dp)
+    {
+        return;
+    }
+    struct dirent *ent;
+    while ((ent = readdir(dp)) != NULL)
+    {
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
+        {
+            continue;
+        }
+        std::string url = dir + "/" + ent->d_name;
+        struct stat st;
+        if (stat((root + url).c_str(), &st) < 0)
+        {
+            continue;
+        }
+        if (S_ISDIR(st.st_mode))
+        {
+            Walk(root, url, urls);
+        }
+        else if (S_ISREG(st.st_mode) && !IsPrecompressedSibling(root + url))
+        {
+            urls.push_back(std::move(url));
+        }
+    }
+    closedir(dp);
+}
+
+WarmupStats Warmup(const char *root)
+{
+    struct timespec begin, end;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+
+    WarmupStats stats;
+    memset(&stats, 0, sizeof(stats));
+
+    std::vector<std::string> urls;
+    Walk(root, "", urls);
+
+    // 同一个文件不带编码和带编码预热时可能是同一个缓存项，只统计一次
+    std::unordered_set<std::shared_ptr<FileEntry>> entries;
+    FileCache *cache = FileCache::Instance();
+    HttpConn conn;
+    for (size_t i = 0; i < urls.size(); ++i)
+    {
+        // 文件缓存满了以后继续预热会淘汰前面预热过（可能已经锁定）的文件，剩下的文件不再预热
+        if (cache->Size() >= cache->MaxEntries())
+        {
+            stats.skipped = urls.size() - i;
+            break;
+        }
+        bool warmed = false;
+        for (const char *encoding : {(const char *)nullptr, BROWSER_ACCEPT_ENCODING})
+        {
+            if (cache->Size() >= cache->MaxEntries())
+            {
+                break;
+            }
+            std::shared_ptr<FileEntry> entry = conn.warm(urls[i].c_str(), encoding);
+            if (!entry)
+            {
+                continue;
+            }
+            warmed = true;
+            if (entries.insert(entry).second)
+            {
+                stats.mappedBytes += entry->size;
+                stats.lockedBytes += entry->locked ? entry->size : 0;
+            }
+        }
+        stats.files += warmed ? 1 : 0;
+    }
+    stats.responseBytes = ResponseCache::Instance()->Bytes();
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    stats.ms = (end.tv_sec - begin.tv_sec) * 1e3 + (end.tv_nsec - begin.tv_nsec) / 1e6;
+    return stats;
+}
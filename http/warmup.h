@@ -0,0 +1,23 @@
+// 启动预热：遍历网站根目录，把所有文件提前放入文件缓存和完整响应缓存，
+// 服务器开始监听后第一批请求就不会因为冷缓存而变慢
+
+#ifndef WARMUP_H
+#define WARMUP_H
+
+#include <stddef.h>
+
+struct WarmupStats
+{
+    size_t files;         // 预热的文件数
+    size_t skipped;       // 文件缓存已满没有预热的文件数
+    size_t mappedBytes;   // 映射进内存的文件字节数（包括预压缩文件）
+    size_t lockedBytes;   // 其中被mlock锁定的字节数
+    size_t responseBytes; // 完整响应缓存中的字节数
+    double ms;            // 耗时
+};
+
+// root：网站根目录，文件的映射方式需要提前用FileCache::SetMapOptions设置
+// 文件缓存满了以后停止预热，不淘汰已经预热的文件，剩下的文件数记在skipped中
+WarmupStats Warmup(const char *root);
+
+#endif
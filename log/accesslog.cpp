@@ -0,0 +1,159 @@
+#include "accesslog.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <chrono>
+
+using namespace std;
+
+AccessLog::AccessLog() : fd_(-1), sampleEvery_(0), capacity_(0), requests_(0),
+                         cachedSec_(-1), dropped_(0), stop_(false) {}
+
+AccessLog::~AccessLog() {
+    // 写线程退出前写完剩下的记录
+    if(writeThread_ && writeThread_->joinable()) {
+        {
+            lock_guard<mutex> locker(mtx_);
+            stop_ = true;
+        }
+        cond_.notify_one();
+        writeThread_->join();
+    }
+    if(fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+AccessLog* AccessLog::Instance() {
+    static AccessLog inst;
+    return &inst;
+}
+
+void AccessLog::init(const char* fileName, int sampleEvery, size_t capacity) {
+    if(sampleEvery <= 0 || fd_ >= 0) {
+        return;
+    }
+    fd_ = open(fileName, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if(fd_ < 0) {
+        return;
+    }
+    sampleEvery_ = sampleEvery;
+    capacity_ = capacity > 0 ? capacity : 1;
+    records_.reserve(capacity_);
+    writeThread_.reset(new thread([this] { Write_(); }));
+}
+
+void AccessLog::Append(const AccessRecord& record) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    bool notify = false;
+    {
+        lock_guard<mutex> locker(mtx_);
+        if(records_.size() >= capacity_) {
+            ++dropped_;
+            return;
+        }
+        records_.push_back(record);
+        records_.back().time = ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+        // 暂存过半时提前唤醒写线程，只通知一次
+        notify = records_.size() == capacity_ / 2 + 1;
+    }
+    if(notify) {
+        cond_.notify_one();
+    }
+}
+
+void AccessLog::Write_() {
+    vector<AccessRecord> batch;
+    batch.reserve(capacity_);
+    unique_ptr<char[]> out(new char[OUT_SIZE]);
+    bool stop = false;
+    while(!stop) {
+        uint64_t dropped;
+        {
+            unique_lock<mutex> locker(mtx_);
+            cond_.wait_for(locker, chrono::milliseconds(FLUSH_INTERVAL_MS), [this] {
+                return stop_ || records_.size() > capacity_ / 2;
+            });
+            stop = stop_;
+            batch.swap(records_);
+            dropped = dropped_;
+            dropped_ = 0;
+        }
+        size_t len = 0;
+        for(const AccessRecord& record : batch) {
+            if(OUT_SIZE - len < MAX_LINE) {
+                Flush_(out.get(), len);
+                len = 0;
+            }
+            len += Format_(record, out.get() + len, MAX_LINE);
+        }
+        if(dropped > 0) {
+            if(OUT_SIZE - len < MAX_LINE) {
+                Flush_(out.get(), len);
+                len = 0;
+            }
+            len += snprintf(out.get() + len, OUT_SIZE - len, "dropped=%llu\n", (unsigned long long)dropped);
+        }
+        Flush_(out.get(), len);
+        batch.clear();
+    }
+}
+
+size_t AccessLog::Format_(const AccessRecord& record, char* dst, size_t cap) {
+    // 同一秒内的记录复用格式化好的时间
+    time_t sec = record.time / 1000000;
+    if(sec != cachedSec_) {
+        struct tm t;
+        localtime_r(&sec, &t);
+        strftime(timeText_, sizeof(timeText_), "%Y-%m-%dT%H:%M:%S", &t);
+        cachedSec_ = sec;
+    }
+    char addr[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &record.addr, addr, sizeof(addr));
+
+    // URL中的空白、控制字符、非ASCII字符和引号按%XX输出，保证一行可以按空格切分
+    char url[AccessRecord::URL_LEN * 3 + 1];
+    size_t n = 0;
+    for(size_t i = 0; i < AccessRecord::URL_LEN && record.url[i]; ++i) {
+        unsigned char c = record.url[i];
+        if(c <= 0x20 || c >= 0x7f || c == '"') {
+            n += snprintf(url + n, sizeof(url) - n, "%%%02X", c);
+        } else {
+            url[n++] = c;
+        }
+    }
+    url[n] = '\0';
+
+    int len = snprintf(dst, cap,
+            "time=%s.%06d client=%s:%u method=%s url=%s status=%u bytes=%llu "
+            "queue_us=%u process_us=%u write_us=%u\n",
+            timeText_, (int)(record.time % 1000000), addr, ntohs(record.port),
+            record.method, n ? url : "-", record.status, (unsigned long long)record.bytes,
+            record.queueUs, record.processUs, record.writeUs);
+    if(len < 0) {
+        return 0;
+    }
+    // 截断时保留换行
+    if((size_t)len >= cap) {
+        dst[cap - 2] = '\n';
+        return cap - 1;
+    }
+    return len;
+}
+
+void AccessLog::Flush_(const char* data, size_t len) {
+    while(len > 0) {
+        ssize_t n = ::write(fd_, data, len);
+        if(n < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        data += n;
+        len -= n;
+    }
+}
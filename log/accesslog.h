@@ -0,0 +1,93 @@
+// 访问日志：每个请求完成时记录一条，包括客户端地址、请求、状态码、发送字节数和各阶段耗时
+// 请求路径上只把定长记录拷贝到内存中的记录数组，格式化和写文件都在专门的写线程中进行；
+// 写线程跟不上时丢弃记录并计数，不会阻塞请求
+// 支持采样：每sampleEvery个请求记录一个，5xx响应总是记录
+// 一行是空格分隔的key=value，例如：
+// time=2026-10-18T23:21:03.870023 client=127.0.0.1:40312 method=GET url=/index.html status=200 bytes=1234 queue_us=12 process_us=40 write_us=105
+
+#ifndef ACCESSLOG_H
+#define ACCESSLOG_H
+
+#include <stdint.h>
+#include <time.h>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct AccessRecord {
+    static constexpr size_t URL_LEN = 256; // 更长的URL被截断
+
+    int64_t time;           // 请求完成时的墙上时间，微秒，由Append填写
+    uint32_t addr;          // 客户端IPv4地址，网络字节序
+    uint16_t port;          // 客户端端口，网络字节序
+    uint16_t status;        // 响应状态码
+    const char* method;     // 请求方法，必须是字符串常量
+    uint64_t bytes;         // 实际发送的字节数
+    uint32_t queueUs;       // 读完请求到工作线程开始处理
+    uint32_t processUs;     // 工作线程解析请求、生成响应
+    uint32_t writeUs;       // 生成响应到发送完成
+    char url[URL_LEN];
+};
+
+class AccessLog {
+public:
+    static AccessLog* Instance();
+
+    // fileName：追加写入的文件；sampleEvery：每几个请求记录一个，0表示关闭
+    // capacity：写线程每次取走之前最多暂存的记录数，超过的记录被丢弃
+    void init(const char* fileName, int sampleEvery, size_t capacity = 8192);
+
+    bool IsOpen() const { return fd_ >= 0; }
+
+    // 这个请求是否需要记录，不记录时不需要填写AccessRecord
+    bool Sample(int status) {
+        if(status >= 500) {
+            return true;
+        }
+        return sampleEvery_ == 1 ||
+               requests_.fetch_add(1, std::memory_order_relaxed) % sampleEvery_ == 0;
+    }
+
+    // 暂存一条记录，由写线程格式化并写入文件
+    void Append(const AccessRecord& record);
+
+    // 单调时钟，微秒，用于计算各阶段耗时
+    static int64_t Now() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+    }
+
+private:
+    AccessLog();
+    ~AccessLog();
+
+    void Write_(); // 写线程：定时或暂存过半时取走记录，格式化后整块写入
+    size_t Format_(const AccessRecord& record, char* dst, size_t cap); // 返回写入的字节数，只在写线程中调用
+    void Flush_(const char* data, size_t len);
+
+    static constexpr size_t OUT_SIZE = 1024 * 1024; // 写线程的输出缓冲区
+    static constexpr size_t MAX_LINE = 1024;       // 一条记录格式化后的最大长度
+    static constexpr int FLUSH_INTERVAL_MS = 1000;
+
+    int fd_;
+    int sampleEvery_;
+    size_t capacity_;
+    std::atomic<uint64_t> requests_;
+
+    // 写线程缓存的当前秒和格式化好的时间
+    time_t cachedSec_;
+    char timeText_[32];
+
+    std::mutex mtx_; // 保护下面的状态
+    std::condition_variable cond_;
+    std::vector<AccessRecord> records_; // 等待写线程取走的记录
+    uint64_t dropped_; // records_满时丢弃的记录数
+    bool stop_;
+    std::unique_ptr<std::thread> writeThread_;
+};
+
+#endif
@@ -0,0 +1,115 @@
+// 二进制日志格式：写日志时只保存格式字符串的地址和原始参数，由logdecode离线格式化成文本
+// 文件由若干段组成，每次打开文件时写入MAGIC开始新的一段，格式字符串的编号只在段内有效
+// 段内是连续的条目：kind(1字节) size(4字节，之后的字节数) 内容
+//   格式条目：编号(8) 格式字符串(size - 8)，后台线程在第一次写入引用它的记录之前写入
+//   记录条目：秒(8) 微秒(4) 级别(1) 参数个数(1) 格式编号(8) 参数...
+//   参数：类型(1) 整数、浮点数、指针为8字节，字符串为长度(4)加内容
+// 所有数值按本机字节序保存，日志只在同一种机器上解码
+
+#ifndef BINARYLOG_H
+#define BINARYLOG_H
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <type_traits>
+
+namespace binlog
+{
+    constexpr char MAGIC[8] = {'W', 'S', 'B', 'L', 'O', 'G', '1', '\n'};
+
+    enum EntryKind : uint8_t
+    {
+        ENTRY_FORMAT = 'F',
+        ENTRY_RECORD = 'R',
+    };
+
+    enum ArgType : uint8_t
+    {
+        ARG_INT = 1,
+        ARG_UINT,
+        ARG_DOUBLE,
+        ARG_STRING,
+        ARG_POINTER,
+    };
+
+    constexpr size_t ENTRY_HEADER_SIZE = 1 + 4;
+    constexpr size_t RECORD_FIXED_SIZE = 8 + 4 + 1 + 1 + 8;
+    constexpr size_t RECORD_FORMAT_OFFSET = 8 + 4 + 1 + 1; // 记录内容中格式编号的位置
+    constexpr size_t MAX_STRING_ARG = 1024;                // 更长的字符串参数被截断
+
+    inline void Put(char *&p, const void *data, size_t len)
+    {
+        memcpy(p, data, len);
+        p += len;
+    }
+
+    template <typename T>
+    constexpr bool IsString = std::is_same_v<std::decay_t<T>, char *> || std::is_same_v<std::decay_t<T>, const char *>;
+
+    inline size_t StringLen(const char *s) { return s ? strnlen(s, MAX_STRING_ARG) : 6; }
+    inline size_t StringLen(const std::string &s) { return std::min(s.size(), MAX_STRING_ARG); }
+
+    // 参数编码后的字节数
+    template <typename T>
+    size_t ArgSize(const T &value)
+    {
+        if constexpr (IsString<T> || std::is_same_v<T, std::string>)
+        {
+            return 1 + 4 + StringLen(value);
+        }
+        else
+        {
+            return 1 + 8;
+        }
+    }
+
+    inline void PutString(char *&p, const char *s, uint32_t len)
+    {
+        *p++ = ARG_STRING;
+        Put(p, &len, 4);
+        Put(p, s ? s : "(null)", len);
+    }
+
+    template <typename T>
+    void Encode(char *&p, const T &value)
+    {
+        using U = std::decay_t<T>;
+        if constexpr (IsString<T>)
+        {
+            PutString(p, value, StringLen(value));
+        }
+        else if constexpr (std::is_same_v<U, std::string>)
+        {
+            PutString(p, value.data(), StringLen(value));
+        }
+        else if constexpr (std::is_floating_point_v<U>)
+        {
+            double v = value;
+            *p++ = ARG_DOUBLE;
+            Put(p, &v, 8);
+        }
+        else if constexpr (std::is_pointer_v<U> || std::is_null_pointer_v<U>)
+        {
+            uint64_t v = reinterpret_cast<uintptr_t>(static_cast<const void *>(value));
+            *p++ = ARG_POINTER;
+            Put(p, &v, 8);
+        }
+        else if constexpr (std::is_enum_v<U> || std::is_signed_v<U>)
+        {
+            int64_t v = static_cast<int64_t>(value);
+            *p++ = ARG_INT;
+            Put(p, &v, 8);
+        }
+        else
+        {
+            static_assert(std::is_unsigned_v<U>, "unsupported binary log argument type");
+            uint64_t v = value;
+            *p++ = ARG_UINT;
+            Put(p, &v, 8);
+        }
+    }
+}
+
+#endif
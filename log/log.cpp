@@ -2,199 +2,613 @@
  * @Author       : mark
  * @Date         : 2020-06-16
  * @copyleft Apache 2.0
- */ 
+ */
 #include "log.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <chrono>
+#include <zlib.h>
 
 using namespace std;
 
+namespace {
+    const char* LEVEL_TITLES[] = {"[debug]: ", "[info] : ", "[warn] : ", "[error]: "};
+    const size_t TITLE_LEN = 9;
+    const size_t TIME_TEXT_LEN = 20; // "YYYY-MM-DD HH:MM:SS."
+
+    // 每个线程缓存当前这一秒的本地时间和格式化好的日期时间，秒数变化时才调用localtime_r
+    struct TimeCache {
+        time_t sec = -1;
+        struct tm t;
+        char text[32];
+    };
+
+    const TimeCache& CurrentTime(bool coarse, long& usec) {
+        thread_local TimeCache cache;
+        struct timespec ts;
+        clock_gettime(coarse ? CLOCK_REALTIME_COARSE : CLOCK_REALTIME, &ts);
+        usec = ts.tv_nsec / 1000;
+        if(ts.tv_sec != cache.sec) {
+            localtime_r(&ts.tv_sec, &cache.t);
+            strftime(cache.text, sizeof(cache.text), "%Y-%m-%d %H:%M:%S.", &cache.t);
+            cache.sec = ts.tv_sec;
+        }
+        return cache;
+    }
+
+    // 写完len字节，出错时放弃剩下的数据
+    void WriteAll(int fd, const char* data, size_t len) {
+        while(len > 0) {
+            ssize_t n = ::write(fd, data, len);
+            if(n < 0) {
+                if(errno == EINTR) {
+                    continue;
+                }
+                return;
+            }
+            data += n;
+            len -= n;
+        }
+    }
+
+    // 第二天零点
+    time_t NextDay(time_t now) {
+        struct tm t;
+        localtime_r(&now, &t);
+        t.tm_mday += 1;
+        t.tm_hour = t.tm_min = t.tm_sec = 0;
+        t.tm_isdst = -1;
+        return mktime(&t);
+    }
+}
+
 Log::Log() {
-    lineCount_ = 0;
     isAsync_ = false;
+    isOpen_ = false;
+    level_ = 1;
+    maxQueue_ = 0;
+    flushIntervalMs_ = 100;
+    flushBytes_ = STAGING_SIZE;
+    fsync_ = false;
+    coarseClock_ = false;
+    binary_ = false;
+    maxFileBytes_ = 0;
+    compress_ = false;
+    fileBytes_ = 0;
+    fileIndex_ = 0;
+    nextDay_ = 0;
     writeThread_ = nullptr;
-    deque_ = nullptr;
-    toDay_ = 0;
-    fp_ = nullptr;
+    fd_ = -1;
+    flushRequested_ = false;
+    stop_ = false;
+    rotateStop_ = false;
 }
 
 Log::~Log() {
-    // 回收子线程
+    // 回收子线程，后台线程退出前会写完已经收集到的日志
     if(writeThread_ && writeThread_->joinable()) {
-        while(!deque_->empty()) {
-            deque_->flush();
-        };
-        deque_->Close();
+        {
+            lock_guard<mutex> locker(queueMtx_);
+            stop_ = true;
+        }
+        cond_.notify_one();
         writeThread_->join();
     }
-    // 将文件描述符中的数据刷新
-    if(fp_) {
-        lock_guard<mutex> locker(mtx_);
-        flush();
-        fclose(fp_);
+    // 写入剩下的日志
+    Collect_();
+    {
+        lock_guard<mutex> locker(writeMtx_);
+        WriteBuffers_(full_);
+        if(fd_ >= 0) {
+            Sync_();
+            close(fd_);
+        }
+    }
+    // 等待旧文件关闭和压缩完成
+    if(rotateThread_ && rotateThread_->joinable()) {
+        {
+            lock_guard<mutex> locker(rotateMtx_);
+            rotateStop_ = true;
+        }
+        rotateCond_.notify_one();
+        rotateThread_->join();
     }
 }
-// 返回级别
-int Log::GetLevel() {
-    lock_guard<mutex> locker(mtx_);
-    return level_;
+
+void Log::SetFlushPolicy(int flushIntervalMs, size_t flushBytes, bool fsync) {
+    flushIntervalMs_ = flushIntervalMs > 0 ? flushIntervalMs : 1;
+    flushBytes_ = min(max<size_t>(flushBytes, 1), STAGING_SIZE);
+    fsync_ = fsync;
 }
-// 设置级别
-void Log::SetLevel(int level) {
-    lock_guard<mutex> locker(mtx_);
-    level_ = level;
+
+void Log::SetRotation(size_t maxFileBytes, bool compress) {
+    maxFileBytes_ = maxFileBytes;
+    compress_ = compress;
 }
 // 初始化，根据级别、路径、后缀、阻塞队列容量大小
 void Log::init(int level = 1, const char* path, const char* suffix,
     int maxQueueSize) {
     isOpen_ = true;
     level_ = level;
-    if(maxQueueSize > 0) { // 如果最大队列容量大于，则是异步
-        isAsync_ = true;
-        if(!deque_) {
-            // 创建阻塞队列
-            unique_ptr<BlockDeque<std::string>> newDeque(new BlockDeque<std::string>);
-            deque_ = move(newDeque);
-            // 创建线程，不停的写数据
-            std::unique_ptr<std::thread> NewThread(new thread(FlushLogThread));
-            writeThread_ = move(NewThread);
+    isAsync_ = maxQueueSize > 0; // 如果最大队列容量大于0，则是异步
+    maxQueue_ = maxQueueSize > 0 ? maxQueueSize : 0;
+
+    path_ = path;
+    suffix_ = suffix;
+
+    {
+        lock_guard<mutex> locker(writeMtx_);
+        if(fd_ >= 0) {
+            Sync_();
+            close(fd_);
         }
-    } else { // 同步
-        isAsync_ = false;
+        fileIndex_ = 0; // 从当天第一个不存在的文件开始
+        OpenFile_(time(nullptr));
     }
 
-    lineCount_ = 0; // 日志行数
+    if(isAsync_ && !writeThread_) {
+        // 创建线程，定时把各线程的缓冲区写入文件
+        writeThread_.reset(new thread(FlushLogThread));
+    }
+}
 
-    time_t timer = time(nullptr);
-    struct tm *sysTime = localtime(&timer);
-    struct tm t = *sysTime;
-    path_ = path;
-    suffix_ = suffix;
+void Log::OpenFile_(time_t now) {
+    struct tm t;
+    localtime_r(&now, &t);
     char fileName[LOG_NAME_LEN] = {0};
-    // 文件名 路径-年-月-日-后缀
-    snprintf(fileName, LOG_NAME_LEN - 1, "%s/%04d_%02d_%02d%s", 
-            path_, t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, suffix_);
-    toDay_ = t.tm_mday;
+    char gzName[LOG_NAME_LEN + 3] = {0};
+    struct stat st;
+    // 文件名 路径/年_月_日[-序号]后缀
+    // 跳过文件或者压缩后的.gz已经存在的序号，重启后不会重新使用之前切换下来的文件名
+    for(;; ++fileIndex_) {
+        if(fileIndex_ == 0) {
+            snprintf(fileName, LOG_NAME_LEN - 1, "%s/%04d_%02d_%02d%s",
+                    path_, t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, suffix_);
+        } else {
+            snprintf(fileName, LOG_NAME_LEN - 1, "%s/%04d_%02d_%02d-%d%s",
+                    path_, t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, fileIndex_, suffix_);
+        }
+        snprintf(gzName, sizeof(gzName), "%s.gz", fileName);
+        if(stat(fileName, &st) != 0 && stat(gzName, &st) != 0) {
+            break;
+        }
+    }
+    fd_ = open(fileName, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if(fd_ < 0) {
+        mkdir(path_, 0777);
+        fd_ = open(fileName, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    }
+    assert(fd_ >= 0);
+    fileName_ = fileName;
+    nextDay_ = NextDay(now);
+    fileBytes_ = 0;
+    // 二进制日志每次打开文件开始新的一段，格式字符串重新写入
+    if(binary_) {
+        WriteAll(fd_, binlog::MAGIC, sizeof(binlog::MAGIC));
+        fileBytes_ += sizeof(binlog::MAGIC);
+        writtenFormats_.clear();
+    }
+}
 
-    {
-        lock_guard<mutex> locker(mtx_);
-        buff_.RetrieveAll(); // 初始化缓冲区
-        if(fp_) { 
-            flush();
-            fclose(fp_); 
+void Log::Sync_() {
+    if(fsync_) {
+        fdatasync(fd_);
+    }
+}
+
+// 返回当前线程的暂存缓冲区，第一次调用时创建并登记
+Log::Staging* Log::LocalStaging_() {
+    // 线程退出时标记，剩下的数据由后台线程写入
+    thread_local struct Holder {
+        shared_ptr<Staging> staging;
+        ~Holder() {
+            if(staging) {
+                lock_guard<mutex> locker(staging->mtx);
+                staging->retired = true;
+            }
         }
-        // 打开文件描述符
-        fp_ = fopen(fileName, "a");
-        if(fp_ == nullptr) {
-            mkdir(path_, 0777);
-            fp_ = fopen(fileName, "a");
-        } 
-        assert(fp_ != nullptr);
+    } holder;
+    if(!holder.staging) {
+        shared_ptr<Staging> staging = make_shared<Staging>();
+        staging->buff.reset(new LogBuffer);
+        lock_guard<mutex> locker(stagingMtx_);
+        stagings_.push_back(staging);
+        holder.staging = staging;
     }
+    return holder.staging.get();
+}
+
+Log::Staging* Log::Lock_(long& usec, const char*& timeText, time_t& sec) {
+    const TimeCache& now = CurrentTime(coarseClock_, usec);
+    timeText = now.text;
+    sec = now.sec;
+    Staging* staging = LocalStaging_();
+    staging->mtx.lock();
+    return staging;
 }
 
 void Log::write(int level, const char *format, ...) {
-    struct timeval now = {0, 0};
-    gettimeofday(&now, nullptr);
-    time_t tSec = now.tv_sec; // 微秒
-    // 把秒数转换为年-月-日-秒
-    struct tm *sysTime = localtime(&tSec);
-    struct tm t = *sysTime;
     va_list vaList; // 不定参数
+    // 二进制模式下不能按参数类型记录，格式化后作为一个字符串参数记录
+    if(binary_) {
+        char line[binlog::MAX_STRING_ARG];
+        va_start(vaList, format);
+        vsnprintf(line, sizeof(line), format, vaList);
+        va_end(vaList);
+        writeBinary(level, "%s", static_cast<const char*>(line));
+        return;
+    }
+
+    long usec;
+    const char* timeText;
+    time_t sec;
+    // 将这条记录格式化到本线程的暂存缓冲区
+    Staging* staging = Lock_(usec, timeText, sec);
+    va_start(vaList, format);
+    size_t len = FormatLine_(staging->buff.get(), timeText, usec, level, format, vaList);
+    va_end(vaList);
+    // 当前缓冲区放不下，交给后台线程后在新的缓冲区中重新格式化
+    if(len > staging->buff->Avail() && staging->buff->len > 0 && isAsync_) {
+        staging->overflow = Submit_(staging->buff);
+        va_start(vaList, format);
+        len = FormatLine_(staging->buff.get(), timeText, usec, level, format, vaList);
+        va_end(vaList);
+    }
+    // 整个缓冲区都放不下的一行被截断
+    Commit_(staging, level, min(len, staging->buff->Avail()));
+}
+
+char* Log::BeginRecord_(int level, const char* format, size_t argc, size_t size, Staging*& staging) {
+    long usec;
+    const char* timeText;
+    time_t sec;
+    staging = Lock_(usec, timeText, sec);
+    if(size > staging->buff->Avail() && staging->buff->len > 0 && isAsync_) {
+        staging->overflow = Submit_(staging->buff);
+    }
+    if(size > staging->buff->Avail()) {
+        return nullptr;
+    }
+    char* p = staging->buff->Tail();
+    uint32_t bodySize = size - binlog::ENTRY_HEADER_SIZE;
+    int64_t sec64 = sec;
+    uint32_t usec32 = usec;
+    uint64_t formatId = reinterpret_cast<uintptr_t>(format);
+    *p++ = binlog::ENTRY_RECORD;
+    binlog::Put(p, &bodySize, 4);
+    binlog::Put(p, &sec64, 8);
+    binlog::Put(p, &usec32, 4);
+    *p++ = static_cast<char>(level);
+    *p++ = static_cast<char>(argc);
+    binlog::Put(p, &formatId, 8);
+    return p;
+}
 
-    /* 日志日期 日志行数 */
-    // 日志日期不是当天，日志行数超过限制需要重新写入新的文件
-    if (toDay_ != t.tm_mday || (lineCount_ && (lineCount_  %  MAX_LINES == 0)))
+void Log::Commit_(Staging* staging, int level, size_t len) {
+    staging->buff->len += len;
+    unique_ptr<LogBuffer> overflow = move(staging->overflow);
+    // 如果是同步就直接写入
+    if(!isAsync_) {
+        lock_guard<mutex> writeLocker(writeMtx_);
+        Rotate_();
+        WriteBuffer_(staging->buff.get());
+        Sync_();
+        staging->buff->len = 0;
+    }
+    // 暂存的日志达到flushBytes_时提交，不等后台线程定时收集
+    else if(staging->buff->len >= flushBytes_ && !overflow) {
+        overflow = Submit_(staging->buff);
+    }
+    staging->mtx.unlock();
+    // 等待写入的缓冲区太多时由当前线程直接写入
+    if(overflow) {
+        lock_guard<mutex> locker(writeMtx_);
+        Rotate_();
+        WriteBuffer_(overflow.get());
+        Sync_();
+        overflow->len = 0;
+        lock_guard<mutex> queueLocker(queueMtx_);
+        free_.push_back(move(overflow));
+    }
+    // 错误日志尽快写入文件
+    if(level >= ERROR_LEVEL) {
+        flush();
+    }
+}
+
+size_t Log::FormatLine_(LogBuffer* buff, const char* timeText, long usec, int level,
+                        const char* format, va_list vaList) {
+    char* dst = buff->Tail();
+    size_t cap = buff->Avail();
+    // 日期时间直接拷贝，只格式化6位微秒
+    size_t n = TIME_TEXT_LEN + 7 + TITLE_LEN;
+    if(n >= cap) {
+        return n + 1;
+    }
+    memcpy(dst, timeText, TIME_TEXT_LEN);
+    for(int i = TIME_TEXT_LEN + 5; i >= static_cast<int>(TIME_TEXT_LEN); --i) {
+        dst[i] = '0' + usec % 10;
+        usec /= 10;
+    }
+    dst[TIME_TEXT_LEN + 6] = ' ';
+    memcpy(dst + TIME_TEXT_LEN + 7, LEVEL_TITLES[level >= 0 && level <= 3 ? level : 1], TITLE_LEN);
+    int m = vsnprintf(dst + n, cap - n, format, vaList);
+    if(m < 0) {
+        m = 0;
+    }
+    // 用换行替换结尾的'\0'，截断时换行放在最后一个字节
+    size_t len = n + m + 1;
+    dst[min(len, cap) - 1] = '\n';
+    return len;
+}
+
+unique_ptr<Log::LogBuffer> Log::Submit_(unique_ptr<LogBuffer>& buff) {
+    unique_ptr<LogBuffer> overflow;
     {
-        unique_lock<mutex> locker(mtx_);
-        locker.unlock();
-        
-        char newFile[LOG_NAME_LEN]; // 新的文件的名字
-        char tail[36] = {0}; // 保存时间
-        snprintf(tail, 36, "%04d_%02d_%02d", t.tm_year + 1900, t.tm_mon + 1, t.tm_mday);
-
-        if (toDay_ != t.tm_mday) // 如果不是当天
+        lock_guard<mutex> locker(queueMtx_);
+        if(full_.size() < maxQueue_) {
+            full_.push_back(move(buff));
+        } else {
+            overflow = move(buff);
+        }
+        buff = TakeFree_();
+    }
+    cond_.notify_one();
+    return overflow;
+}
+
+unique_ptr<Log::LogBuffer> Log::TakeFree_() {
+    if(free_.empty()) {
+        return unique_ptr<LogBuffer>(new LogBuffer);
+    }
+    unique_ptr<LogBuffer> buff = move(free_.back());
+    free_.pop_back();
+    return buff;
+}
+
+void Log::Collect_() {
+    lock_guard<mutex> locker(stagingMtx_);
+    for(auto it = stagings_.begin(); it != stagings_.end();) {
+        Staging& staging = **it;
+        bool retired;
         {
-            // 保存新文件名称
-            snprintf(newFile, LOG_NAME_LEN - 72, "%s/%s%s", path_, tail, suffix_);
-            toDay_ = t.tm_mday;
-            lineCount_ = 0;
+            lock_guard<mutex> stagingLocker(staging.mtx);
+            if(staging.buff->len > 0) {
+                lock_guard<mutex> queueLocker(queueMtx_);
+                full_.push_back(move(staging.buff));
+                staging.buff = TakeFree_();
+            }
+            retired = staging.retired;
         }
-        else { // 如果日志行数超出限制
-            // 保存新文件名称
-            snprintf(newFile, LOG_NAME_LEN - 72, "%s/%s-%d%s", path_, tail, (lineCount_  / MAX_LINES), suffix_);
+        it = retired ? stagings_.erase(it) : it + 1;
+    }
+}
+
+void Log::WriteBuffers_(vector<unique_ptr<LogBuffer>>& buffs) {
+    static const size_t BATCH = 64;
+    for(size_t i = 0, end; i < buffs.size(); i = end) {
+        struct iovec iov[BATCH + 1];
+        size_t cnt = 0;
+        // 每批写入前检查是否需要切换文件，一批不超过当前文件剩下的大小，至少一个缓冲区
+        Rotate_();
+        size_t bytes = buffs[i]->len;
+        for(end = i + 1; end < buffs.size() && end - i < BATCH; ++end) {
+            if(maxFileBytes_ > 0 && fileBytes_ + bytes + buffs[end]->len > maxFileBytes_) {
+                break;
+            }
+            bytes += buffs[end]->len;
         }
-        
-        locker.lock();
-        flush();
-        fclose(fp_);
-        // 创建新文件
-        fp_ = fopen(newFile, "a");
-        assert(fp_ != nullptr);
+        // 二进制模式下新出现的格式字符串写在引用它们的记录前面
+        if(binary_) {
+            for(size_t k = i; k < end; ++k) {
+                AddFormats_(buffs[k].get());
+            }
+            if(!formats_.empty()) {
+                iov[cnt].iov_base = &formats_[0];
+                iov[cnt++].iov_len = formats_.size();
+            }
+        }
+        for(size_t k = i; k < end; ++k) {
+            iov[cnt].iov_base = buffs[k]->data.get();
+            iov[cnt++].iov_len = buffs[k]->len;
+        }
+        ssize_t n = writev(fd_, iov, cnt);
+        size_t written = n > 0 ? n : 0;
+        // 部分写入时剩下的逐块写完
+        for(size_t k = 0; k < cnt; ++k) {
+            if(written >= iov[k].iov_len) {
+                written -= iov[k].iov_len;
+                continue;
+            }
+            WriteAll(fd_, static_cast<char*>(iov[k].iov_base) + written, iov[k].iov_len - written);
+            written = 0;
+        }
+        for(size_t k = 0; k < cnt; ++k) {
+            fileBytes_ += iov[k].iov_len;
+        }
+        formats_.clear();
+    }
+}
+
+void Log::WriteBuffer_(LogBuffer* buff) {
+    if(binary_) {
+        AddFormats_(buff);
+        WriteAll(fd_, formats_.data(), formats_.size());
+        fileBytes_ += formats_.size();
+        formats_.clear();
+    }
+    WriteAll(fd_, buff->data.get(), buff->len);
+    fileBytes_ += buff->len;
+}
+
+void Log::AddFormats_(const LogBuffer* buff) {
+    const char* p = buff->data.get();
+    const char* end = p + buff->len;
+    while(p + binlog::ENTRY_HEADER_SIZE <= end) {
+        uint32_t size;
+        memcpy(&size, p + 1, 4);
+        if(*p == binlog::ENTRY_RECORD) {
+            uint64_t id;
+            memcpy(&id, p + binlog::ENTRY_HEADER_SIZE + binlog::RECORD_FORMAT_OFFSET, 8);
+            const char* format = reinterpret_cast<const char*>(id);
+            if(writtenFormats_.insert(format).second) {
+                uint32_t len = strlen(format);
+                uint32_t bodySize = 8 + len;
+                formats_.push_back(binlog::ENTRY_FORMAT);
+                formats_.append(reinterpret_cast<const char*>(&bodySize), 4);
+                formats_.append(reinterpret_cast<const char*>(&id), 8);
+                formats_.append(format, len);
+            }
+        }
+        p += binlog::ENTRY_HEADER_SIZE + size;
+    }
+}
+
+void Log::Recycle_(vector<unique_ptr<LogBuffer>>& buffs) {
+    static const size_t MAX_FREE = 32;
+    lock_guard<mutex> locker(queueMtx_);
+    for(unique_ptr<LogBuffer>& buff : buffs) {
+        if(free_.size() >= MAX_FREE) {
+            break;
+        }
+        buff->len = 0;
+        free_.push_back(move(buff));
     }
-    // 将这条记录打印到日志文件中
+    buffs.clear();
+}
+
+// 切换日志文件，在写入一批日志之前调用，之前的日志已经写入旧文件，新文件只需要打开
+void Log::Rotate_() {
+    time_t now = time(nullptr);
+    bool newDay = now >= nextDay_;
+    if(!newDay && (maxFileBytes_ == 0 || fileBytes_ < maxFileBytes_)) {
+        return;
+    }
+    fileIndex_ = newDay ? 0 : fileIndex_ + 1;
+    int oldFd = fd_;
+    string oldName = move(fileName_);
+    OpenFile_(now);
+    Retire_(oldFd, oldName);
+}
+
+void Log::Retire_(int fd, const string& fileName) {
     {
-        unique_lock<mutex> locker(mtx_);
-        lineCount_++;
-        // buff保存要输出的文件内容
-        int n = snprintf(buff_.BeginWrite(), 128, "%d-%02d-%02d %02d:%02d:%02d.%06ld ",
-                    t.tm_year + 1900, t.tm_mon + 1, t.tm_mday,
-                    t.tm_hour, t.tm_min, t.tm_sec, now.tv_usec);
-        // buff改变写指针
-        buff_.HasWritten(n);
-        AppendLogLevelTitle_(level);
-
-        // 将不定参数的内容写入buff中
-        va_start(vaList, format);
-        int m = vsnprintf(buff_.BeginWrite(), buff_.WritableBytes(), format, vaList);
-        va_end(vaList);
-        // buff更新写指针，并添加换行结束符
-        buff_.HasWritten(m);
-        buff_.Append("\n\0", 2);
-        // 如果是异步就是写入到阻塞队列中，如果是同步就直接写入
-        if(isAsync_ && deque_ && !deque_->full()) {
-            deque_->push_back(buff_.RetrieveAllToStr());
-        } else {
-            fputs(buff_.Peek(), fp_);
-        }
-        // 缓冲区重置
-        buff_.RetrieveAll();
-    }
-    printf("写了一份日志---------------------------\n");
-}
-// 向缓冲区中添加级别
-void Log::AppendLogLevelTitle_(int level) {
-    switch(level) {
-    case 0:
-        buff_.Append("[debug]: ", 9);
-        break;
-    case 1:
-        buff_.Append("[info] : ", 9);
-        break;
-    case 2:
-        buff_.Append("[warn] : ", 9);
-        break;
-    case 3:
-        buff_.Append("[error]: ", 9);
-        break;
-    default:
-        buff_.Append("[info] : ", 9);
-        break;
-    }
-}
-// 刷新缓冲区
+        lock_guard<mutex> locker(rotateMtx_);
+        retired_.emplace_back(fd, fileName);
+        if(!rotateThread_) {
+            rotateThread_.reset(new thread([this] { RetireFiles_(); }));
+        }
+    }
+    rotateCond_.notify_one();
+}
+
+// 关闭旧文件，fsync模式下先刷到磁盘，再按需要压缩；这个线程降低优先级，不和工作线程争CPU
+void Log::RetireFiles_() {
+    setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19);
+    vector<pair<int, string>> files;
+    while(true) {
+        {
+            unique_lock<mutex> locker(rotateMtx_);
+            rotateCond_.wait(locker, [this] { return !retired_.empty() || rotateStop_; });
+            if(retired_.empty()) {
+                return;
+            }
+            files.swap(retired_);
+        }
+        for(auto& file : files) {
+            if(fsync_) {
+                fdatasync(file.first);
+            }
+            close(file.first);
+            if(compress_) {
+                Compress_(file.second);
+            }
+        }
+        files.clear();
+    }
+}
+
+// 压缩成fileName.gz，先写临时文件，完成后链接到最终的文件名并删除原文件，失败时保留原文件
+// 已经存在的.gz不会被覆盖，改用fileName.1.gz、fileName.2.gz……
+void Log::Compress_(const string& fileName) {
+    int in = open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+    if(in < 0) {
+        return;
+    }
+    string tmpName = fileName + ".gz.tmp";
+    gzFile out = gzopen(tmpName.c_str(), "wb6");
+    bool ok = out != nullptr;
+    char buf[64 * 1024];
+    ssize_t n;
+    while(ok && (n = read(in, buf, sizeof(buf))) != 0) {
+        if(n < 0) {
+            ok = errno == EINTR;
+            continue;
+        }
+        ok = gzwrite(out, buf, n) == n;
+    }
+    close(in);
+    if(out && gzclose(out) != Z_OK) {
+        ok = false;
+    }
+    if(ok) {
+        // link在目标存在时失败，不会像rename一样替换掉之前的压缩文件
+        string gzName = fileName + ".gz";
+        for(int i = 1; link(tmpName.c_str(), gzName.c_str()) != 0; ++i) {
+            if(errno != EEXIST) {
+                ok = false;
+                break;
+            }
+            gzName = fileName + "." + to_string(i) + ".gz";
+        }
+    }
+    if(ok) {
+        unlink(fileName.c_str());
+    }
+    unlink(tmpName.c_str());
+}
+
+// 通知后台线程收集，已经通知过还没有处理时不再通知
 void Log::flush() {
-    if(isAsync_) { 
-        // 刷新队列
-        deque_->flush(); 
+    if(isAsync_ && !flushRequested_.load(memory_order_relaxed) && !flushRequested_.exchange(true)) {
+        cond_.notify_one();
     }
-    // 刷新文件描述符
-    fflush(fp_);
 }
-// 异步写
+// 异步写：提交的缓冲区到达时写入，每隔flushIntervalMs_或被要求时收集所有线程未写满的缓冲区
 void Log::AsyncWrite_() {
-    string str = "";
-    while(deque_->pop(str)) {
-        lock_guard<mutex> locker(mtx_);
-        fputs(str.c_str(), fp_);
+    vector<unique_ptr<LogBuffer>> batch;
+    auto interval = chrono::milliseconds(flushIntervalMs_);
+    auto deadline = chrono::steady_clock::now() + interval;
+    bool stop = false;
+    while(!stop) {
+        bool collect;
+        {
+            unique_lock<mutex> locker(queueMtx_);
+            cond_.wait_until(locker, deadline, [this] {
+                return !full_.empty() || flushRequested_ || stop_;
+            });
+            stop = stop_;
+            collect = flushRequested_.exchange(false) || stop || chrono::steady_clock::now() >= deadline;
+        }
+        if(collect) {
+            Collect_();
+            deadline = chrono::steady_clock::now() + interval;
+        }
+        {
+            lock_guard<mutex> locker(writeMtx_);
+            {
+                lock_guard<mutex> queueLocker(queueMtx_);
+                batch.swap(full_);
+            }
+            if(!batch.empty()) {
+                WriteBuffers_(batch);
+                Sync_();
+            }
+        }
+        Recycle_(batch);
     }
 }
 // 单例模式，返回静态变量
@@ -2,80 +2,262 @@
  * @Author       : mark
  * @Date         : 2020-06-16
  * @copyleft Apache 2.0
- */ 
+ */
 #ifndef LOG_H
 #define LOG_H
 
 #include <mutex>
 #include <string>
 #include <thread>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <condition_variable>
 #include <sys/time.h>
+#include <time.h>
 #include <string.h>
 #include <stdarg.h>           // vastart va_end
 #include <assert.h>
 #include <sys/stat.h>         //mkdir
-#include "blockqueue.h"
-#include "../buffer/buffer.h"
+#include <unordered_set>
+#include "binarylog.h"
 
+// 异步模式下每个线程把日志格式化到自己的暂存缓冲区，写满后整块交给后台线程，
+// 后台线程定时收集所有线程未写满的缓冲区，用一次writev把一批缓冲区写入文件
+// 写日志只锁自己线程的暂存缓冲区，只有后台线程收集时才会有竞争
+// 写入文件的时机由刷新策略决定：线程暂存超过flushBytes时整块提交，后台线程每flushIntervalMs收集一次，
+// 错误级别的日志立即通知后台线程；fsync模式下每批写入后调用fdatasync
+// 二进制模式下写日志只保存格式字符串地址和参数（见binarylog.h），不在请求路径上格式化
+// 按日期和文件大小切换文件都在后台线程写入前进行，旧文件交给低优先级的线程关闭和压缩，写日志的线程不会等待
 class Log {
 public:
-    void init(int level, const char* path = "./log", 
+    // maxQueueCapacity：最多排队等待写入的满缓冲区数，0表示同步写
+    void init(int level, const char* path = "./log",
                 const char* suffix =".log",
                 int maxQueueCapacity = 1024);
 
     static Log* Instance();
     static void FlushLogThread();
 
+    // 刷新策略，在init之前设置
+    // flushIntervalMs：后台线程收集各线程暂存日志的间隔
+    // flushBytes：一个线程暂存的日志达到这个大小时立即提交，不超过STAGING_SIZE
+    // fsync：每批日志写入后调用fdatasync，保证写入磁盘
+    void SetFlushPolicy(int flushIntervalMs, size_t flushBytes, bool fsync);
+
+    // 文件切换策略，在init之前设置
+    // maxFileBytes：当前文件超过这个大小后切换到当天的下一个文件，0表示只按日期切换
+    // compress：切换下来的文件用gzip压缩成.gz并删除原文件
+    void SetRotation(size_t maxFileBytes, bool compress);
+
+    // coarse：用CLOCK_REALTIME_COARSE取时间，不需要读硬件时钟，微秒部分的精度为一个时钟节拍（几毫秒）
+    void SetCoarseClock(bool coarse) { coarseClock_ = coarse; }
+
+    // 二进制日志模式，在init之前设置，文件用logdecode转换成文本
+    void SetBinary(bool binary) { binary_ = binary; }
+    bool IsBinary() const { return binary_; }
+
     void write(int level, const char *format,...);
-    void flush();
 
-    int GetLevel();
-    void SetLevel(int level);
+    // 二进制模式下记录一条日志，format必须是字符串字面量（LOG_BASE保证），写入文件时才读取它的内容
+    template <typename... Args>
+    void writeBinary(int level, const char *format, const Args&... args) {
+        size_t size = binlog::ENTRY_HEADER_SIZE + binlog::RECORD_FIXED_SIZE + (binlog::ArgSize(args) + ... + 0);
+        Staging* staging;
+        char* p = BeginRecord_(level, format, sizeof...(Args), size, staging);
+        if(p) {
+            (binlog::Encode(p, args), ...);
+        }
+        Commit_(staging, level, p ? size : 0);
+    }
+
+    void flush(); // 通知后台线程立即收集并写入，同步模式下不需要
+
+    // 每条日志都要检查级别，用relaxed原子变量，不加锁
+    int GetLevel() const { return level_.load(std::memory_order_relaxed); }
+    void SetLevel(int level) { level_.store(level, std::memory_order_relaxed); }
     bool IsOpen() { return isOpen_; }
-    
+
 private:
+    // 固定大小的日志缓冲区，在线程和后台线程之间整块交换
+    struct LogBuffer {
+        LogBuffer() : data(new char[STAGING_SIZE]), len(0) {}
+        char* Tail() { return data.get() + len; }
+        size_t Avail() const { return STAGING_SIZE - len; }
+
+        std::unique_ptr<char[]> data;
+        size_t len;
+    };
+
+    // 一个线程的暂存缓冲区，线程退出后标记为retired，后台线程写完剩余数据后移除
+    struct Staging {
+        std::mutex mtx;
+        std::unique_ptr<LogBuffer> buff;
+        std::unique_ptr<LogBuffer> overflow; // 队列已满时换下来的缓冲区，解锁后由本线程写入
+        bool retired = false;
+    };
+
     Log();
-    void AppendLogLevelTitle_(int level);
     virtual ~Log();
+    Staging* LocalStaging_();
+    // 取得当前时间，然后锁定本线程的暂存缓冲区
+    Staging* Lock_(long& usec, const char*& timeText, time_t& sec);
+    // 锁定暂存缓冲区并写入记录头，返回写参数的位置，放不下时返回nullptr
+    char* BeginRecord_(int level, const char* format, size_t argc, size_t size, Staging*& staging);
+    // 提交已经写入暂存缓冲区的len字节，按刷新策略处理后解锁
+    void Commit_(Staging* staging, int level, size_t len);
+    // 把一行写入buff，返回这一行需要的字节数（包括换行），大于可用空间时没有写完
+    // timeText：缓存的"YYYY-MM-DD HH:MM:SS."
+    size_t FormatLine_(LogBuffer* buff, const char* timeText, long usec, int level,
+                       const char* format, va_list vaList);
+    // 把写满的缓冲区交给后台线程并换一块空缓冲区，队列已满时返回原缓冲区由调用者直接写入
+    std::unique_ptr<LogBuffer> Submit_(std::unique_ptr<LogBuffer>& buff);
+    std::unique_ptr<LogBuffer> TakeFree_(); // 调用时持有queueMtx_
+    void Collect_(); // 把所有线程暂存缓冲区中的数据移到full_
+    void WriteBuffers_(std::vector<std::unique_ptr<LogBuffer>>& buffs); // 调用时持有writeMtx_
+    void WriteBuffer_(LogBuffer* buff); // 调用时持有writeMtx_
+    // 二进制模式下为buff中第一次出现的格式字符串生成格式条目，追加到formats_，调用时持有writeMtx_
+    void AddFormats_(const LogBuffer* buff);
+    void Recycle_(std::vector<std::unique_ptr<LogBuffer>>& buffs);
+    void OpenFile_(time_t now); // 打开now那天从第fileIndex_个开始第一个不存在的文件，调用时持有writeMtx_
+    void Sync_(); // fsync模式下把已经写入的数据刷到磁盘，调用时持有writeMtx_
+    // 到了第二天或者当前文件达到maxFileBytes_时切换文件，旧文件交给Retire_，调用时持有writeMtx_
+    void Rotate_();
+    void Retire_(int fd, const std::string& fileName); // 把切换下来的文件交给rotateThread_
+    void Compress_(const std::string& fileName);
     void AsyncWrite_();
+    void RetireFiles_(); // rotateThread_的线程函数：关闭旧文件，需要时压缩
 
 private:
     static const int LOG_PATH_LEN = 256;
     static const int LOG_NAME_LEN = 256;
-    static const int MAX_LINES = 50000;
+    static constexpr size_t STAGING_SIZE = 64 * 1024; // 每个暂存缓冲区的大小，超过的一行被截断
+    static const int ERROR_LEVEL = 3; // 不低于这个级别的日志立即通知后台线程
 
     const char* path_;
     const char* suffix_;
 
-    int MAX_LINES_; // 一个日志文件的最大的行数
+    size_t maxFileBytes_; // 一个日志文件的最大字节数
+    bool compress_; // 是否压缩切换下来的文件
 
-    int lineCount_; // 当前文件的行数
-    int toDay_; // 当前的日期
+    // 下面的文件状态只在持有writeMtx_时访问
+    std::string fileName_; // 当前文件名
+    size_t fileBytes_; // 当前文件的大小
+    int fileIndex_; // 当天的第几个文件
+    time_t nextDay_; // 第二天零点，到了之后切换文件
 
     bool isOpen_; // 是否打开
- 
-    Buffer buff_; // 缓冲区
-    int level_; // 当前的级别
+
+    std::atomic<int> level_; // 当前的级别
     bool isAsync_; // 是否异步
+    size_t maxQueue_; // 最多排队的满缓冲区数
+
+    int flushIntervalMs_;
+    size_t flushBytes_;
+    bool fsync_;
+    bool coarseClock_;
+    bool binary_;
+    std::unordered_set<const char*> writtenFormats_; // 当前文件中已经写入的格式字符串
+    std::string formats_; // 待写入的格式条目
+
+    int fd_; // 写文件的文件描述符
+    std::mutex writeMtx_; // 保护文件描述符，写文件和切换文件时持有
 
-    FILE* fp_; // 写文件的文件描述符
-    std::unique_ptr<BlockDeque<std::string>> deque_; // 阻塞队列
+    std::mutex stagingMtx_; // 保护stagings_
+    std::vector<std::shared_ptr<Staging>> stagings_; // 所有线程的暂存缓冲区
+
+    std::mutex queueMtx_; // 保护下面的队列和状态
+    std::condition_variable cond_;
+    std::vector<std::unique_ptr<LogBuffer>> full_; // 等待写入的缓冲区
+    std::vector<std::unique_ptr<LogBuffer>> free_; // 写完可以复用的缓冲区
+    std::atomic<bool> flushRequested_;
+    bool stop_;
     std::unique_ptr<std::thread> writeThread_; // 写线程
-    std::mutex mtx_; // 互斥锁
+
+    std::mutex rotateMtx_; // 保护下面的队列和状态
+    std::condition_variable rotateCond_;
+    std::vector<std::pair<int, std::string>> retired_; // 等待关闭的旧文件
+    bool rotateStop_;
+    std::unique_ptr<std::thread> rotateThread_; // 关闭和压缩旧文件的线程，第一次切换时创建
 };
 
+// format前后拼接空字符串，只接受字符串字面量，传入数组或指针时编译失败：
+// 二进制日志只记录格式字符串的地址，后台线程写入文件时才读取它的内容
 #define LOG_BASE(level, format, ...) \
     do {\
         Log* log = Log::Instance();\
         if (log->IsOpen() && log->GetLevel() <= level) {\
-            log->write(level, format, ##__VA_ARGS__); \
-            log->flush();\
+            if (log->IsBinary()) {\
+                log->writeBinary(level, "" format "", ##__VA_ARGS__); \
+            } else {\
+                log->write(level, "" format "", ##__VA_ARGS__); \
+            }\
         }\
     } while(0);
 
+// 低于LOG_MIN_LEVEL的日志在编译时去掉，参数也不会被求值，由CMake的LOG_MIN_LEVEL设置
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 0
+#endif
+
+#if LOG_MIN_LEVEL <= 0
 #define LOG_DEBUG(format, ...) do {LOG_BASE(0, format, ##__VA_ARGS__)} while(0);
+#else
+#define LOG_DEBUG(format, ...) do {} while(0);
+#endif
+#if LOG_MIN_LEVEL <= 1
 #define LOG_INFO(format, ...) do {LOG_BASE(1, format, ##__VA_ARGS__)} while(0);
+#else
+#define LOG_INFO(format, ...) do {} while(0);
+#endif
+#if LOG_MIN_LEVEL <= 2
 #define LOG_WARN(format, ...) do {LOG_BASE(2, format, ##__VA_ARGS__)} while(0);
+#else
+#define LOG_WARN(format, ...) do {} while(0);
+#endif
 #define LOG_ERROR(format, ...) do {LOG_BASE(3, format, ##__VA_ARGS__)} while(0);
 
+// 每个调用点独立的限速器：每intervalMs最多放行一次，记录期间被丢弃的次数
+class LogRateLimiter {
+public:
+    explicit LogRateLimiter(int intervalMs) : interval_(intervalMs * 1000000LL), next_(0), suppressed_(0) {}
+
+    // 可以输出时返回true，suppressed为上次输出以来被丢弃的次数
+    bool Allow(long& suppressed) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+        long long now = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+        long long next = next_.load(std::memory_order_relaxed);
+        if(now < next || !next_.compare_exchange_strong(next, now + interval_, std::memory_order_relaxed)) {
+            suppressed_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        suppressed = suppressed_.exchange(0, std::memory_order_relaxed);
+        return true;
+    }
+
+private:
+    const long long interval_;
+    std::atomic<long long> next_;
+    std::atomic<long> suppressed_;
+};
+
+// 可能每个请求都触发的警告，同一个调用点每intervalMs最多写一条，并带上被丢弃的条数
+#if LOG_MIN_LEVEL <= 2
+#define LOG_WARN_LIMITED(intervalMs, format, ...) \
+    do {\
+        static LogRateLimiter limiter(intervalMs);\
+        long suppressed;\
+        if (limiter.Allow(suppressed)) {\
+            if (suppressed > 0) {\
+                LOG_BASE(2, format " (%ld suppressed)", ##__VA_ARGS__, suppressed)\
+            } else {\
+                LOG_BASE(2, format, ##__VA_ARGS__)\
+            }\
+        }\
+    } while(0);
+#else
+#define LOG_WARN_LIMITED(intervalMs, format, ...) do {} while(0);
+#endif
+
 #endif //LOG_H
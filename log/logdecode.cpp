@@ -0,0 +1,275 @@
+// 把二进制日志转换成和文本日志相同格式的文本
+// 用法：logdecode file.blog [...]，结果输出到标准输出
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "binarylog.h"
+
+namespace
+{
+    const char *LEVEL_TITLES[] = {"[debug]: ", "[info] : ", "[warn] : ", "[error]: "};
+
+    struct Arg
+    {
+        binlog::ArgType type = binlog::ARG_INT;
+        int64_t i = 0;
+        uint64_t u = 0;
+        double d = 0;
+        std::string s;
+    };
+
+    template <typename T>
+    T Get(const char *&p)
+    {
+        T v;
+        memcpy(&v, p, sizeof(v));
+        p += sizeof(v);
+        return v;
+    }
+
+    // 按一个转换说明格式化一个参数，spec已经去掉了长度修饰符
+    template <typename T>
+    void Append(std::string &out, const std::string &spec, T value)
+    {
+        char buf[256];
+        int n = snprintf(buf, sizeof(buf), spec.c_str(), value);
+        if (n >= static_cast<int>(sizeof(buf)))
+        {
+            std::vector<char> big(n + 1);
+            snprintf(big.data(), big.size(), spec.c_str(), value);
+            out.append(big.data(), n);
+        }
+        else if (n > 0)
+        {
+            out.append(buf, n);
+        }
+    }
+
+    int64_t AsInt(const Arg &arg)
+    {
+        return arg.type == binlog::ARG_INT ? arg.i : static_cast<int64_t>(arg.u);
+    }
+
+    // 按printf的规则用记录的参数展开格式字符串
+    std::string Format(const std::string &format, const std::vector<Arg> &args)
+    {
+        std::string out;
+        size_t next = 0;
+        for (size_t i = 0; i < format.size(); ++i)
+        {
+            if (format[i] != '%')
+            {
+                out.push_back(format[i]);
+                continue;
+            }
+            if (i + 1 < format.size() && format[i + 1] == '%')
+            {
+                out.push_back('%');
+                ++i;
+                continue;
+            }
+            // 标志、宽度、精度原样保留，*从参数中取值
+            std::string spec = "%";
+            size_t j = i + 1;
+            while (j < format.size() && strchr("-+ #0'", format[j]))
+            {
+                spec.push_back(format[j++]);
+            }
+            for (int part = 0; part < 2; ++part)
+            {
+                if (part == 1)
+                {
+                    if (j >= format.size() || format[j] != '.')
+                    {
+                        break;
+                    }
+                    spec.push_back(format[j++]);
+                }
+                if (j < format.size() && format[j] == '*')
+                {
+                    spec += next < args.size() ? std::to_string(AsInt(args[next++])) : "0";
+                    ++j;
+                }
+                while (j < format.size() && isdigit(static_cast<unsigned char>(format[j])))
+                {
+                    spec.push_back(format[j++]);
+                }
+            }
+            // 参数都按64位保存，去掉原来的长度修饰符
+            while (j < format.size() && strchr("hlLqjzt", format[j]))
+            {
+                ++j;
+            }
+            if (j >= format.size())
+            {
+                out += format.substr(i);
+                break;
+            }
+            char conv = format[j];
+            i = j;
+            if (conv == 'n')
+            {
+                continue;
+            }
+            if (next >= args.size())
+            {
+                out += "<missing>";
+                continue;
+            }
+            const Arg &arg = args[next++];
+            switch (conv)
+            {
+            case 'd':
+            case 'i':
+                Append(out, spec + "ll" + conv, static_cast<long long>(AsInt(arg)));
+                break;
+            case 'u':
+            case 'o':
+            case 'x':
+            case 'X':
+                Append(out, spec + "ll" + conv, static_cast<unsigned long long>(arg.type == binlog::ARG_INT ? arg.i : arg.u));
+                break;
+            case 'c':
+                Append(out, spec + conv, static_cast<int>(AsInt(arg)));
+                break;
+            case 'e':
+            case 'E':
+            case 'f':
+            case 'F':
+            case 'g':
+            case 'G':
+            case 'a':
+            case 'A':
+                Append(out, spec + conv, arg.type == binlog::ARG_DOUBLE ? arg.d : static_cast<double>(AsInt(arg)));
+                break;
+            case 's':
+                Append(out, spec + conv, arg.type == binlog::ARG_STRING ? arg.s.c_str() : "<not a string>");
+                break;
+            case 'p':
+                Append(out, spec + conv, reinterpret_cast<void *>(static_cast<uintptr_t>(arg.u)));
+                break;
+            default:
+                out += spec + conv;
+                break;
+            }
+        }
+        return out;
+    }
+
+    bool Decode(const std::string &data, const char *name)
+    {
+        std::unordered_map<uint64_t, std::string> formats;
+        const char *p = data.data();
+        const char *end = p + data.size();
+        while (p < end)
+        {
+            // 新的一段，之前的格式编号失效
+            if (static_cast<size_t>(end - p) >= sizeof(binlog::MAGIC) &&
+                memcmp(p, binlog::MAGIC, sizeof(binlog::MAGIC)) == 0)
+            {
+                formats.clear();
+                p += sizeof(binlog::MAGIC);
+                continue;
+            }
+            if (static_cast<size_t>(end - p) < binlog::ENTRY_HEADER_SIZE)
+            {
+                break;
+            }
+            char kind = *p++;
+            uint32_t size = Get<uint32_t>(p);
+            if (static_cast<size_t>(end - p) < size)
+            {
+                break;
+            }
+            const char *body = p;
+            p += size;
+            if (kind == binlog::ENTRY_FORMAT && size >= 8)
+            {
+                uint64_t id = Get<uint64_t>(body);
+                formats[id].assign(body, size - 8);
+            }
+            else if (kind == binlog::ENTRY_RECORD && size >= binlog::RECORD_FIXED_SIZE)
+            {
+                time_t sec = Get<int64_t>(body);
+                uint32_t usec = Get<uint32_t>(body);
+                int level = static_cast<uint8_t>(*body++);
+                int argc = static_cast<uint8_t>(*body++);
+                uint64_t id = Get<uint64_t>(body);
+                std::vector<Arg> args(argc);
+                for (Arg &arg : args)
+                {
+                    if (body >= p)
+                    {
+                        break;
+                    }
+                    arg.type = static_cast<binlog::ArgType>(*body++);
+                    if (arg.type == binlog::ARG_STRING)
+                    {
+                        uint32_t len = Get<uint32_t>(body);
+                        arg.s.assign(body, len);
+                        body += len;
+                    }
+                    else if (arg.type == binlog::ARG_INT)
+                    {
+                        arg.i = Get<int64_t>(body);
+                    }
+                    else if (arg.type == binlog::ARG_DOUBLE)
+                    {
+                        arg.d = Get<double>(body);
+                    }
+                    else
+                    {
+                        arg.u = Get<uint64_t>(body);
+                    }
+                }
+                struct tm t;
+                localtime_r(&sec, &t);
+                auto it = formats.find(id);
+                std::string text = it != formats.end() ? Format(it->second, args) : "<unknown format>";
+                printf("%d-%02d-%02d %02d:%02d:%02d.%06u %s%s\n",
+                       t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec,
+                       usec, LEVEL_TITLES[level <= 3 ? level : 1], text.c_str());
+            }
+        }
+        if (p != end)
+        {
+            fprintf(stderr, "%s: truncated entry at offset %zu\n", name, static_cast<size_t>(p - data.data()));
+            return false;
+        }
+        return true;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s file.blog [...]\n", argv[0]);
+        return 1;
+    }
+    int ret = 0;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::ifstream in(argv[i], std::ios::binary);
+        if (!in)
+        {
+            fprintf(stderr, "%s: cannot open\n", argv[i]);
+            ret = 1;
+            continue;
+        }
+        std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        if (!Decode(data, argv[i]))
+        {
+            ret = 1;
+        }
+    }
+    return ret;
+}
@@ -1,10 +1,32 @@
 #include "./pool/threadpool.h"
 #include "./timer/srp_timer.h"
 #include "./log/log.h"
+#include "./log/accesslog.h"
+#include "./http/warmup.h"
+#include "./pool/conntable.h"
 
 #define MAX_FD 65535           // 最大文件描述符数
 #define MAX_EVENT_NUMBER 10000 // 监听的最大事件数量
 #define TIMESLOT 5             // 单位时间
+#define GZIP_LEVEL 6           // 实时gzip压缩等级，0表示关闭
+#define GZIP_MIN_SIZE 1024     // 小于这个大小的文件不压缩
+#define GZIP_MAX_SIZE (4 * 1024 * 1024) // 大于这个大小的文件不在工作线程中压缩
+#define FILE_CACHE_ENTRIES 1024 // 文件缓存最多保存的文件数
+#define RESPONSE_CACHE_BYTES (32 * 1024 * 1024) // 完整响应缓存的容量，0表示关闭
+#define RESPONSE_CACHE_MAX_FILE 4096            // 只有不超过这个大小的文件缓存完整响应
+#define NEGATIVE_CACHE_SLOTS 16384 // 不存在路径缓存的大小，0表示关闭
+#define NEGATIVE_CACHE_TTL 10      // 不存在路径的记录有效秒数
+#define IO_THREADS 2           // 预读冷文件的I/O线程数，0表示不预读
+#define HUGE_PAGE_MIN_SIZE (2 * 1024 * 1024) // -H时不小于这个大小的文件使用透明大页
+#define LOG_FLUSH_INTERVAL_MS 100 // 后台线程收集日志的间隔
+#define LOG_FLUSH_BYTES (64 * 1024) // 一个线程暂存的日志达到这个大小时立即提交
+#define LOG_FSYNC false           // 每批日志写入后是否fdatasync
+#define LOG_MAX_FILE_BYTES (64 * 1024 * 1024) // 日志文件超过这个大小后切换到新文件
+#define LOG_COMPRESS_ROTATED true // 切换下来的日志文件用gzip压缩
+#define LOG_COARSE_CLOCK true     // 日志时间用CLOCK_REALTIME_COARSE，微秒部分精度为一个时钟节拍
+#define ACCESS_LOG_FILE "./log/access.log" // -a时访问日志的文件
+#define ACCESS_LOG_CAPACITY 8192 // 访问日志写线程每次取走之前最多暂存的记录数
+#define BUFFER_POOL_IDLE_BYTES (4 * 1024 * 1024) // 缓冲区池每个级别最多保留物理内存的空闲字节数
 
 static int pipefd[2];            // noactive的管道
 static sort_timer_srp timer_srp; // noactive的容器
@@ -18,6 +40,8 @@ extern void removefd(int epollfd, int fd);
 extern void modfd(int epollfd, int fd, int ev);
 // 设置fd非阻塞
 extern int setnonblocking(int fd);
+// 网站根目录
+extern const char *doc_root;
 
 // 添加信号捕捉
 // handler：回调函数
@@ -27,7 +51,12 @@ void addSig(int sig, void(handler)(int))
     memset( &sa, '\0', sizeof( sa ) );
     sa.sa_handler = handler;
     sigfillset( &sa.sa_mask );
-    assert( sigaction( sig, &sa, NULL ) != -1 );
+    // 不能写在assert中，定义NDEBUG的发布构建会去掉整个调用
+    if ( sigaction( sig, &sa, NULL ) == -1 )
+    {
+        perror( "sigaction" );
+        exit( -1 );
+    }
 }
 
 // noactive向管道发送信号
@@ -45,17 +74,75 @@ void timer_handler()
 {
     // 定时处理任务，实际上就是调用tick()函数
     timer_srp.tick();
+    LOG_DEBUG("timers %d, refs %d, users %ld", timer_srp.getsize_(), timer_srp.getrefsize(), HttpConn::m_user_count.Sum());
+
+    // 归还空闲缓冲区多余的物理内存
+    BufferPool *pool = BufferPool::Instance();
+    pool->Shrink();
+    // 统计只用于debug日志，编译时去掉debug日志时不需要读取，避免每次都锁各个级别
+#if LOG_MIN_LEVEL <= 0
+    for (size_t i = 0; i < BufferPool::CLASS_COUNT; ++i)
+    {
+        BufferPoolStats st = pool->Stats(i);
+        LOG_DEBUG("buffer pool %zu: leases %ld, cache hits %ld, leased %zu, high water %zu, idle %zu, mapped %zu",
+                  st.blockSize, st.leases, st.cacheHits, st.leased, st.highWater, st.idle, st.mapped);
+    }
+#endif
 
     // 因为一次 alarm 调用只会引起一次SIGALARM 信号，所以我们要重新定时，以不断触发 SIGALARM信号。
     alarm(TIMESLOT);
 }
 
+void cb_func(HttpConn *user_data);
+
+// 创建定时器，设置其回调函数与超时时间，然后绑定定时器与用户数据，最后将定时器添加到堆中
+void add_user_timer(HttpConn *user, time_t expire)
+{
+    TimerNode *timer = new TimerNode;
+    timer->user_data = user; // 用户信息
+    timer->cb_func = cb_func; // 回调函数
+    timer->expire = expire;   // 设置失效时间
+    user->timer = timer;      // 设置定时器
+    timer_srp.add_timer(timer);
+}
+
 // 定时器回调函数，它删除非活动连接socket上的注册事件，并关闭之。
+// 调用之后定时器会被删除，清空连接上的指针，避免之后再使用已经释放的定时器
+// 连接还在工作线程或I/O线程中处理时，缓冲区和文件映射正在被使用，不能关闭，换一个定时器推迟到下一个TIMESLOT
 void cb_func(HttpConn *user_data)
 {
+    user_data->timer = NULL;
+    if (user_data->in_flight())
+    {
+        add_user_timer(user_data, time(NULL) + TIMESLOT);
+        return;
+    }
     user_data->close_conn();
 }
 
+// 关闭连接并删除它的定时器，在主线程处理这个连接的事件时调用，这一轮EPOLLONESHOT属于主线程
+void close_user(HttpConn *user)
+{
+    TimerNode *timer = user->timer;
+    user->timer = NULL;
+    user->close_conn();
+    if (timer)
+    {
+        timer_srp.del_timer(timer);
+    }
+}
+
+// 连接有读写活动时延迟它被关闭的时间
+void extend_timer(HttpConn *user)
+{
+    TimerNode *timer = user->timer;
+    if (timer)
+    {
+        timer->expire = time(NULL) + 2 * TIMESLOT;
+        timer_srp.adjust_timer(timer); // 调整失效时间
+    }
+}
+
 int main(int argc, char *argv[])
 {
 
@@ -63,7 +150,14 @@ int main(int argc, char *argv[])
     { // 运行时加上端口号
         // basename：用于去除路径和文件后缀部分的文件名，只获取执行程序名称
         // eg：./server 8080
-        printf("按照如下格式运行: %s port_number\n", basename(argv[0]));
+        printf("按照如下格式运行: %s port_number [-r doc_root] [-e] [-w] [-l] [-H] [-b] [-a N]\n", basename(argv[0]));
+        printf("  -r  网站根目录，默认为编译时指定的DOC_ROOT\n");
+        printf("  -e  只从编译进程序的资源响应，不访问文件系统\n");
+        printf("  -w  启动时预热网站根目录下的所有文件\n");
+        printf("  -l  预热时用mlock把文件锁定在内存中\n");
+        printf("  -H  预热时大文件使用透明大页\n");
+        printf("  -b  二进制日志，用logdecode转换成文本\n");
+        printf("  -a  写访问日志，每N个请求记录一个，5xx总是记录\n");
         exit(-1);
     }
 
@@ -71,6 +165,41 @@ int main(int argc, char *argv[])
     // atoi:字符串转换成整型数
     int port = atoi(argv[1]);
 
+    // 端口号之后的可选参数
+    bool warmup = false, lock_files = false, huge_pages = false, binary_log = false;
+    int access_sample = 0;
+    int opt;
+    optind = 2;
+    while ((opt = getopt(argc, argv, "r:ewlHba:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'r':
+            doc_root = optarg;
+            break;
+        case 'e':
+            HttpConn::m_embedded = true;
+            break;
+        case 'w':
+            warmup = true;
+            break;
+        case 'l':
+            lock_files = true;
+            break;
+        case 'H':
+            huge_pages = true;
+            break;
+        case 'b':
+            binary_log = true;
+            break;
+        case 'a':
+            access_sample = atoi(optarg);
+            break;
+        default:
+            exit(-1);
+        }
+    }
+
     /* 对SIGPIPE信号进行处理
        当 client 连接到 server 之后,
        这时候 server 准备向 client 发送多条消息
@@ -88,14 +217,18 @@ int main(int argc, char *argv[])
     try
     {
         pool = new ThreadPool<HttpConn>;
+        if (IO_THREADS > 0)
+        {
+            HttpConn::m_io_pool = new ThreadPool<PrefetchTask>(IO_THREADS, MAX_FD);
+        }
     }
     catch (...)
     {
         return 1;
     }
 
-    // 创建一个数组用于保存所有连接过来的客户端信息
-    HttpConn *users = new HttpConn[MAX_FD];
+    // 按fd保存所有连接过来的客户端信息，连接对象按块分配，I/O缓冲区只在连接打开时借用
+    ConnTable<HttpConn> users(MAX_FD);
 
     /*
      * 网络模块
@@ -111,8 +244,52 @@ int main(int argc, char *argv[])
     }
 
     // 创建日志文件系统
-    Log::Instance()->init(1, "./log", ".log", 1024);
+    Log::Instance()->SetFlushPolicy(LOG_FLUSH_INTERVAL_MS, LOG_FLUSH_BYTES, LOG_FSYNC);
+    Log::Instance()->SetRotation(LOG_MAX_FILE_BYTES, LOG_COMPRESS_ROTATED);
+    Log::Instance()->SetCoarseClock(LOG_COARSE_CLOCK);
+    Log::Instance()->SetBinary(binary_log);
+    Log::Instance()->init(1, "./log", binary_log ? ".blog" : ".log", 1024);
     LOG_INFO("========== Server init ==========");
+    AccessLog::Instance()->init(ACCESS_LOG_FILE, access_sample, ACCESS_LOG_CAPACITY);
+
+    // 文件缓存与实时压缩的配置
+    FileCache::Instance()->init(GZIP_LEVEL, GZIP_MIN_SIZE, GZIP_MAX_SIZE, FILE_CACHE_ENTRIES);
+
+    // I/O缓冲区池
+    BufferPool::Instance()->init(BUFFER_POOL_IDLE_BYTES);
+
+    // 嵌入模式下不访问文件系统，不需要这两个缓存
+    if (HttpConn::m_embedded)
+    {
+        LOG_INFO("serving %zu embedded assets", EMBEDDED_ASSET_COUNT);
+        printf("嵌入模式: %zu个资源\n", EMBEDDED_ASSET_COUNT);
+    }
+    else
+    {
+        ResponseCache::Instance()->init(RESPONSE_CACHE_BYTES, RESPONSE_CACHE_MAX_FILE);
+        NegativeCache::Instance()->init(NEGATIVE_CACHE_SLOTS, NEGATIVE_CACHE_TTL);
+    }
+
+    // 公共响应头，读事件会把连接的超时时间延长到2 * TIMESLOT
+    CommonHeaders::init("WebServer-dev", 2 * TIMESLOT);
+
+    // 在开始监听前预热，之后的请求一开始就是稳定状态的延迟
+    if (warmup && !HttpConn::m_embedded)
+    {
+        FileCache::Instance()->SetMapOptions(true, lock_files, huge_pages ? HUGE_PAGE_MIN_SIZE : 0);
+        WarmupStats stats = Warmup(doc_root);
+        // 只有预热的文件预读和锁定，运行时的映射由I/O线程预读，不在工作线程中同步读入
+        FileCache::Instance()->SetMapOptions(false, false, 0);
+        LOG_INFO("warmup: %zu files in %.1f ms, %zu bytes mapped, %zu bytes locked, %zu bytes of responses cached",
+                 stats.files, stats.ms, stats.mappedBytes, stats.lockedBytes, stats.responseBytes);
+        printf("预热完成: %zu个文件, 耗时%.1fms, 映射%zu字节, 锁定%zu字节, 缓存响应%zu字节\n",
+               stats.files, stats.ms, stats.mappedBytes, stats.lockedBytes, stats.responseBytes);
+        if (stats.skipped > 0)
+        {
+            LOG_WARN("warmup: file cache full after %zu files, %zu files not warmed", stats.files, stats.skipped);
+            printf("文件缓存已满, %zu个文件没有预热\n", stats.skipped);
+        }
+    }
 
     // 设置端口复用
     int reuse = 1;
@@ -158,10 +335,21 @@ int main(int argc, char *argv[])
 
     // 创建管道 noactive-1 创建一个两端通信的管道
     ret = socketpair(PF_UNIX, SOCK_STREAM, 0, pipefd);
-    assert(ret != -1);
+    if (ret == -1)
+    {
+        perror("socketpair");
+        exit(-1);
+    }
     setnonblocking(pipefd[1]);
     addfd(epollfd, pipefd[0], false);
 
+    // 网站根目录下有新文件时清空不存在路径的缓存
+    int inotifyfd = HttpConn::m_embedded ? -1 : NegativeCache::Instance()->Watch(doc_root);
+    if (inotifyfd >= 0)
+    {
+        addfd(epollfd, inotifyfd, false);
+    }
+
     // 设置信号处理函数 noactive-2 SIGALRM定时器信号，SIGTERM进程终止信号
     addSig(SIGALRM, sig_handler);
     addSig(SIGTERM, sig_handler);
@@ -173,9 +361,6 @@ int main(int argc, char *argv[])
     // 循环检测事件发生
     while (true)
     {
-        printf("timer_srp.size = %d,ref_ size = %d\n", timer_srp.getsize_(), timer_srp.getrefsize());
-        printf("当前用户数:%d\n", HttpConn::m_user_count);
-
         // num：epoll监听到发生了事件的个数
         int num = epoll_wait(epollfd, events, MAX_EVENT_NUMBER, -1);
         if ((num < 0) && (errno != EINTR))
@@ -199,30 +384,38 @@ int main(int argc, char *argv[])
                 struct sockaddr_in client_address;
                 socklen_t client_addrlen = sizeof(client_address);
                 int connfd = accept(listenfd, (struct sockaddr *)&client_address, &client_addrlen);
+                if (connfd < 0)
+                {
+                    continue;
+                }
 
-                if (HttpConn::m_user_count >= MAX_FD)
+                HttpConn *user = users.Get(connfd);
+                if (HttpConn::m_user_count.Sum() >= MAX_FD || !user)
                 {
                     // 目前连接满
                     // todo：给客户端写信息，说服务器繁忙，响应报文
+                    LOG_WARN_LIMITED(1000, "connection limit reached, refused fd %d", connfd);
                     close(connfd);
                     continue;
                 }
 
-                // 将新的客户数据初始化，放到数组中，将connfd添加到epoll对象中
-                users[connfd].init(connfd, client_address);
-
-                // 创建定时器，设置其回调函数与超时时间，然后绑定定时器与用户数据，最后将定时器添加到链表timer_lst中
+                // 这个fd上一个连接在工作线程中被关闭时，它的定时器还在堆中，先删除
+                if (user->timer)
+                {
+                    timer_srp.del_timer(user->timer);
+                    user->timer = NULL;
+                }
 
-                printf("新用户connfd = %d\n", connfd);
+                // 将新的客户数据初始化，借用缓冲区，将connfd添加到epoll对象中
+                if (!user->init(connfd, client_address))
+                {
+                    LOG_WARN_LIMITED(1000, "no buffer for new connection, refused fd %d", connfd);
+                    close(connfd);
+                    continue;
+                }
 
-                TimerNode *timer = new TimerNode;
-                timer->user_data = &users[connfd];  // 用户信息
-                timer->cb_func = cb_func;           // 回调函数
-                time_t cur = time(NULL);            // 当前时间
-                timer->expire = cur + 3 * TIMESLOT; // 设置失效时间
-                users[connfd].timer = timer;        // 设置定时器
-                timer_srp.add_timer(timer);
-                printf("向timer中添加fd = %d\n", connfd);
+                add_user_timer(user, time(NULL) + 3 * TIMESLOT);
+                LOG_DEBUG("new connection fd %d", connfd);
             }
             else if ((sockfd == pipefd[0]) && (events[i].events & EPOLLIN))
             {
@@ -260,46 +453,44 @@ int main(int argc, char *argv[])
                     }
                 }
             }
+            else if (sockfd == inotifyfd)
+            {
+                NegativeCache::Instance()->HandleEvents();
+            }
+            else if (HttpConn *user = users.Find(sockfd); !user)
+            {
+                continue;
+            }
             else if (events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR))
             {
-                TimerNode *timer = users[sockfd].timer;
-                cb_func(&users[sockfd]);
-                if (timer)
-                {
-                    timer_srp.del_timer(timer);
-                }
+                close_user(user);
             }
             else if (events[i].events & EPOLLIN)
             {
-                TimerNode *timer = users[sockfd].timer;
                 // 如果是读事件
-                if (users[sockfd].read())
+                // 交给工作线程之前登记，队列已满时撤销并关闭连接
+                user->begin_task();
+                if (user->read() && pool->append(user))
                 {
-                    pool->append(users + sockfd);
                     // 延迟该连接被关闭的时间
-                    if (timer)
-                    {
-                        time_t cur = time(NULL);
-                        timer->expire = cur + 2 * TIMESLOT;
-                        printf("adjust timer once\n");
-                        timer_srp.adjust_timer(timer); // 调整失效时间
-                    }
+                    extend_timer(user);
                 }
                 else
                 {
-                    cb_func(&users[sockfd]);
-                    if (timer)
-                    {
-                        timer_srp.del_timer(timer);
-                    }
+                    user->end_task();
+                    close_user(user);
                 }
             }
             else if (events[i].events & EPOLLOUT)
             {
-                // 如果是写事件
-                if (!users[sockfd].write())
+                // 如果是写事件，大文件发送期间也要延长超时时间，否则会被定时器关闭
+                if (user->write())
+                {
+                    extend_timer(user);
+                }
+                else
                 {
-                    users[sockfd].close_conn();
+                    close_user(user);
                 }
             }
         }
@@ -315,8 +506,8 @@ int main(int argc, char *argv[])
     close(pipefd[0]);
     close(epollfd);
     close(listenfd);
-    delete[] users;
     delete pool;
+    delete HttpConn::m_io_pool;
 
     return 0;
 }
\ No newline at end of file
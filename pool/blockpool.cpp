@@ -0,0 +1,128 @@
+#include "blockpool.h"
+#include <sys/mman.h>
+#include <unistd.h>
+#include <algorithm>
+#include "counter.h"
+
+BlockPool::BlockPool(size_t blockSize, size_t maxIdle)
+    : maxIdle_(maxIdle), leased_(0), highWater_(0), hotIdle_(0)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t align = blockSize >= page ? page : CACHELINE_SIZE;
+    blockSize_ = (blockSize + align - 1) / align * align;
+}
+
+BlockPool::~BlockPool()
+{
+    for (void *slab : slabs_)
+    {
+        munmap(slab, blockSize_ * SLAB_BLOCKS);
+    }
+}
+
+// 映射一个新的slab并把其中的块放入空闲链表，调用时持有锁
+// 新映射的页还没有物理内存，放在链表前面，和已经释放物理内存的块一样对待
+bool BlockPool::Grow_()
+{
+    void *slab = mmap(NULL, blockSize_ * SLAB_BLOCKS, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (slab == MAP_FAILED)
+    {
+        return false;
+    }
+    slabs_.push_back(slab);
+    free_.insert(free_.begin(), SLAB_BLOCKS, NULL);
+    for (size_t i = 0; i < SLAB_BLOCKS; ++i)
+    {
+        free_[i] = (char *)slab + (SLAB_BLOCKS - 1 - i) * blockSize_;
+    }
+    return true;
+}
+
+void *BlockPool::Lease()
+{
+    void *block = nullptr;
+    LeaseBatch(&block, 1);
+    return block;
+}
+
+void BlockPool::Release(void *block)
+{
+    if (block)
+    {
+        ReleaseBatch(&block, 1);
+    }
+}
+
+size_t BlockPool::LeaseBatch(void **blocks, size_t n)
+{
+    std::lock_guard<std::mutex> locker(mtx_);
+    if (free_.size() < n && !Grow_() && free_.empty())
+    {
+        return 0;
+    }
+    n = std::min(n, free_.size());
+    std::copy(free_.end() - n, free_.end(), blocks);
+    free_.resize(free_.size() - n);
+    hotIdle_ -= std::min(hotIdle_, n);
+    leased_ += n;
+    highWater_ = std::max(highWater_, leased_);
+    return n;
+}
+
+void BlockPool::ReleaseBatch(void *const *blocks, size_t n)
+{
+    std::lock_guard<std::mutex> locker(mtx_);
+    free_.insert(free_.end(), blocks, blocks + n);
+    hotIdle_ += n;
+    leased_ -= n;
+}
+
+void BlockPool::SetMaxIdle(size_t maxIdle)
+{
+    std::lock_guard<std::mutex> locker(mtx_);
+    maxIdle_ = maxIdle;
+}
+
+size_t BlockPool::Shrink()
+{
+    std::lock_guard<std::mutex> locker(mtx_);
+    size_t released = 0;
+    // 小于一页的块和相邻的块共用页，不能单独释放物理内存
+    if (blockSize_ % sysconf(_SC_PAGESIZE) != 0)
+    {
+        return 0;
+    }
+    while (hotIdle_ > maxIdle_)
+    {
+        // 最久没有使用的有物理内存的块
+        madvise(free_[free_.size() - hotIdle_], blockSize_, MADV_DONTNEED);
+        hotIdle_--;
+        released++;
+    }
+    return released;
+}
+
+size_t BlockPool::Leased()
+{
+    std::lock_guard<std::mutex> locker(mtx_);
+    return leased_;
+}
+
+size_t BlockPool::HighWater()
+{
+    std::lock_guard<std::mutex> locker(mtx_);
+    return highWater_;
+}
+
+size_t BlockPool::Idle()
+{
+    std::lock_guard<std::mutex> locker(mtx_);
+    return free_.size();
+}
+
+size_t BlockPool::Mapped()
+{
+    std::lock_guard<std::mutex> locker(mtx_);
+    return slabs_.size() * SLAB_BLOCKS;
+}
@@ -0,0 +1,59 @@
+// 固定大小内存块池，是BufferPool中每个大小级别的中心存储
+// 内存块从一次映射SLAB_BLOCKS块的匿名内存中切分，不小于一页的块按页对齐；归还的块保留在空闲链表中，
+// 超过maxIdle的空闲块由Shrink用MADV_DONTNEED把物理内存还给内核，地址保留下次直接复用
+
+#ifndef BLOCKPOOL_H
+#define BLOCKPOOL_H
+
+#include <stddef.h>
+#include <mutex>
+#include <vector>
+
+class BlockPool
+{
+public:
+    // blockSize不小于一页时向上取整到页大小，否则取整到缓存行大小
+    // maxIdle：Shrink后最多保留物理内存的空闲块数
+    BlockPool(size_t blockSize, size_t maxIdle);
+    ~BlockPool();
+
+    // 借用一块内存，内容不做初始化；分配失败返回nullptr
+    void *Lease();
+
+    // 归还Lease得到的内存块
+    void Release(void *block);
+
+    // 一次借用最多n块，返回实际借到的块数，供线程本地缓存批量补充
+    size_t LeaseBatch(void **blocks, size_t n);
+
+    // 一次归还n块
+    void ReleaseBatch(void *const *blocks, size_t n);
+
+    void SetMaxIdle(size_t maxIdle);
+
+    // 释放超过maxIdle的空闲块的物理内存，返回释放的块数，由主线程定时调用
+    size_t Shrink();
+
+    size_t BlockSize() const { return blockSize_; }
+    size_t Leased();    // 不在空闲链表中的块数，包括线程本地缓存中的块
+    size_t HighWater(); // Leased曾经达到的最大值
+    size_t Idle();
+    size_t Mapped();    // 已经映射的块数
+
+private:
+    static const size_t SLAB_BLOCKS = 64;
+
+    bool Grow_();
+
+    size_t blockSize_;
+    size_t maxIdle_;
+    size_t leased_;
+    size_t highWater_;
+    // 空闲链表，末尾是最近归还的块；末尾的hotIdle_块仍有物理内存，前面的已经MADV_DONTNEED
+    std::vector<void *> free_;
+    size_t hotIdle_;
+    std::vector<void *> slabs_;
+    std::mutex mtx_;
+};
+
+#endif
@@ -0,0 +1,119 @@
+#include "bufferpool.h"
+#include <algorithm>
+
+const size_t BufferPool::CLASS_SIZES[CLASS_COUNT] = {4 * 1024};
+
+BufferPool::BufferPool()
+    : pools_{BlockPool(CLASS_SIZES[0], 0)}
+{
+    init(4 * 1024 * 1024);
+}
+
+BufferPool *BufferPool::Instance()
+{
+    static BufferPool inst;
+    return &inst;
+}
+
+void BufferPool::init(size_t maxIdleBytes)
+{
+    for (size_t i = 0; i < CLASS_COUNT; ++i)
+    {
+        pools_[i].SetMaxIdle(maxIdleBytes / CLASS_SIZES[i]);
+    }
+}
+
+size_t BufferPool::ClassIndex_(size_t size)
+{
+    size_t i = 0;
+    while (i < CLASS_COUNT && CLASS_SIZES[i] < size)
+    {
+        ++i;
+    }
+    return i;
+}
+
+BufferPool::ThreadCache &BufferPool::Cache_()
+{
+    thread_local ThreadCache cache;
+    return cache;
+}
+
+size_t BufferPool::CacheLimit_(size_t cls)
+{
+    return std::min(ThreadCache::MAX_BLOCKS, std::max<size_t>(2, ThreadCache::CACHE_BYTES / CLASS_SIZES[cls]));
+}
+
+BufferPool::ThreadCache::~ThreadCache()
+{
+    BufferPool *pool = Instance();
+    for (size_t i = 0; i < CLASS_COUNT; ++i)
+    {
+        pool->pools_[i].ReleaseBatch(blocks[i], count[i]);
+        count[i] = 0;
+    }
+}
+
+void *BufferPool::Lease(size_t size)
+{
+    size_t cls = ClassIndex_(size);
+    if (cls == CLASS_COUNT)
+    {
+        return nullptr;
+    }
+    leases_[cls].Add();
+    ThreadCache &cache = Cache_();
+    size_t &count = cache.count[cls];
+    if (count > 0)
+    {
+        cacheHits_[cls].Add();
+    }
+    else
+    {
+        // 一次补充一半，之后的几次借用不需要加锁
+        count = pools_[cls].LeaseBatch(cache.blocks[cls], CacheLimit_(cls) / 2);
+        if (count == 0)
+        {
+            return nullptr;
+        }
+    }
+    return cache.blocks[cls][--count];
+}
+
+void BufferPool::Release(void *block, size_t size)
+{
+    if (!block)
+    {
+        return;
+    }
+    size_t cls = ClassIndex_(size);
+    ThreadCache &cache = Cache_();
+    size_t &count = cache.count[cls];
+    size_t limit = CacheLimit_(cls);
+    if (count == limit)
+    {
+        // 归还最早放入的一半，保留最近用过、还在CPU缓存中的块
+        size_t half = limit / 2;
+        pools_[cls].ReleaseBatch(cache.blocks[cls], half);
+        std::copy(cache.blocks[cls] + half, cache.blocks[cls] + count, cache.blocks[cls]);
+        count -= half;
+    }
+    cache.blocks[cls][count++] = block;
+}
+
+size_t BufferPool::Shrink()
+{
+    size_t released = 0;
+    for (BlockPool &pool : pools_)
+    {
+        released += pool.Shrink();
+    }
+    return released;
+}
+
+BufferPoolStats BufferPool::Stats(size_t cls)
+{
+    BlockPool &pool = pools_[cls];
+    return {pool.BlockSize(), leases_[cls].Sum(), cacheHits_[cls].Sum(),
+            pool.Leased(), pool.HighWater(), pool.Idle(), pool.Mapped()};
+}
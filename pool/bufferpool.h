@@ -0,0 +1,72 @@
+// 全局I/O缓冲区池，按大小分成几个级别，每个级别由一个BlockPool作为中心存储
+// 每个线程为每个级别保留少量空闲块，借用和归还通常不需要加锁；
+// 线程本地缓存空了从中心存储批量补充，满了批量归还一半
+// 连接的缓冲区只在需要时借用，用完归还，占用的内存随并发数变化，而不是随连接上限变化
+// 目前只有连接的ConnBuffers从这里借用，所以只有一个4KB的级别；其他大小的使用者在CLASS_SIZES中增加级别
+
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <stddef.h>
+#include "blockpool.h"
+#include "counter.h"
+
+struct BufferPoolStats
+{
+    size_t blockSize;
+    long leases;     // 借用次数
+    long cacheHits;  // 直接从线程本地缓存得到的次数
+    size_t leased;   // 不在中心存储中的块数，包括线程本地缓存中的块
+    size_t highWater; // leased曾经达到的最大值
+    size_t idle;     // 中心存储中的空闲块数
+    size_t mapped;   // 已经映射的块数
+};
+
+class BufferPool
+{
+public:
+    static constexpr size_t CLASS_COUNT = 1;
+    static const size_t CLASS_SIZES[CLASS_COUNT]; // 4KB
+    static constexpr size_t MAX_SIZE = 4 * 1024;
+
+    static BufferPool *Instance();
+
+    // maxIdleBytes：每个级别Shrink后最多保留物理内存的空闲字节数
+    void init(size_t maxIdleBytes);
+
+    // 从能容纳size字节的最小级别借用一块，size超过MAX_SIZE或分配失败返回nullptr
+    void *Lease(size_t size);
+
+    // 归还Lease(size)得到的块，size与借用时相同或是所在级别的大小
+    void Release(void *block, size_t size);
+
+    // 释放各级别多余空闲块的物理内存，返回释放的块数，由主线程定时调用
+    size_t Shrink();
+
+    BufferPoolStats Stats(size_t cls);
+
+private:
+    BufferPool();
+    ~BufferPool() = default;
+
+    static size_t ClassIndex_(size_t size);
+
+    // 线程本地缓存，线程退出时把缓存的块还给中心存储
+    struct ThreadCache
+    {
+        static constexpr size_t CACHE_BYTES = 64 * 1024; // 每个级别最多缓存的字节数
+        static constexpr size_t MAX_BLOCKS = 32;
+
+        ~ThreadCache();
+        void *blocks[CLASS_COUNT][MAX_BLOCKS];
+        size_t count[CLASS_COUNT] = {};
+    };
+    static ThreadCache &Cache_();
+    static size_t CacheLimit_(size_t cls);
+
+    BlockPool pools_[CLASS_COUNT];
+    ShardedCounter leases_[CLASS_COUNT];
+    ShardedCounter cacheHits_[CLASS_COUNT];
+};
+
+#endif
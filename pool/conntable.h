@@ -0,0 +1,64 @@
+// 按fd索引的连接表
+// 连接对象按CHUNK_SIZE个一块分配，某一块第一次有fd落入时才分配，之后一直复用，
+// 内存占用只和同时打开的最大fd有关，而不是预先为MAX_FD个连接全部分配
+
+#ifndef CONNTABLE_H
+#define CONNTABLE_H
+
+#include <stddef.h>
+
+// 只在主线程中调用Get/Find，工作线程只使用已经取得的对象指针
+template <typename T>
+class ConnTable
+{
+public:
+    explicit ConnTable(int maxFd)
+        : chunkCount_((maxFd + CHUNK_SIZE - 1) / CHUNK_SIZE), chunks_(new T *[chunkCount_]())
+    {
+    }
+
+    ~ConnTable()
+    {
+        for (int i = 0; i < chunkCount_; ++i)
+        {
+            delete[] chunks_[i];
+        }
+        delete[] chunks_;
+    }
+
+    ConnTable(const ConnTable &) = delete;
+    ConnTable &operator=(const ConnTable &) = delete;
+
+    // 取得fd对应的连接对象，所在的块还没有分配时分配；fd超出范围返回nullptr
+    T *Get(int fd)
+    {
+        if (fd < 0 || fd / CHUNK_SIZE >= chunkCount_)
+        {
+            return nullptr;
+        }
+        T *&chunk = chunks_[fd / CHUNK_SIZE];
+        if (!chunk)
+        {
+            chunk = new T[CHUNK_SIZE];
+        }
+        return chunk + fd % CHUNK_SIZE;
+    }
+
+    // 取得fd对应的连接对象，不分配；没有时返回nullptr
+    T *Find(int fd) const
+    {
+        if (fd < 0 || fd / CHUNK_SIZE >= chunkCount_ || !chunks_[fd / CHUNK_SIZE])
+        {
+            return nullptr;
+        }
+        return chunks_[fd / CHUNK_SIZE] + fd % CHUNK_SIZE;
+    }
+
+private:
+    static const int CHUNK_SIZE = 64;
+
+    int chunkCount_;
+    T **chunks_;
+};
+
+#endif
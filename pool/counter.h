@@ -0,0 +1,48 @@
+// 按线程分片的计数器
+// 多个线程频繁增减、偶尔读取的统计量（如连接数）如果用同一个变量，每次修改都会让缓存行在CPU之间来回传递。
+// 这里每个线程只修改自己的分片，分片按缓存行对齐互不干扰，读取时汇总所有分片。
+
+#ifndef COUNTER_H
+#define COUNTER_H
+
+#include <atomic>
+
+#define CACHELINE_SIZE 64 // 缓存行大小，用于对齐被不同线程写入的数据
+
+class ShardedCounter
+{
+public:
+    void Add(long n = 1) { shards_[Index_()].value.fetch_add(n, std::memory_order_relaxed); }
+    void Sub(long n = 1) { shards_[Index_()].value.fetch_sub(n, std::memory_order_relaxed); }
+
+    // 汇总所有分片，和并发的修改之间没有同步，结果是近似值
+    long Sum() const
+    {
+        long sum = 0;
+        for (const Shard &shard : shards_)
+        {
+            sum += shard.value.load(std::memory_order_relaxed);
+        }
+        return sum;
+    }
+
+private:
+    static const int SHARDS = 16;
+
+    struct alignas(CACHELINE_SIZE) Shard
+    {
+        std::atomic<long> value{0};
+    };
+
+    // 每个线程第一次使用时分配一个分片，线程数超过SHARDS时共用
+    static int Index_()
+    {
+        static std::atomic<int> next{0};
+        thread_local int index = next.fetch_add(1, std::memory_order_relaxed) % SHARDS;
+        return index;
+    }
+
+    Shard shards_[SHARDS];
+};
+
+#endif
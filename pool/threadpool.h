@@ -5,6 +5,7 @@
 #include <cstdio>
 #include "../http/httpConn.h"
 #include "locker.h"
+#include "../log/log.h"
 
 
 // 线程池类
@@ -83,8 +84,6 @@ ThreadPool<T>::ThreadPool(int thread_num, int max_requests):
     // 创建m_thread_number个线程，并将他们设置成线程分离，让线程自己释放资源
     for (int i = 0; i < m_thread_number; i++)
     {
-        printf("Create the num: %d thread\n", i);
-
         // 作为this指针参数传入线程执行函数worker，此函数必须为静态函数
         // 后面work函数即可访问非静态成员对象
         if(pthread_create(m_threads + i, NULL, worker, this) != 0)
@@ -17,7 +17,6 @@ sort_timer_srp::~sort_timer_srp() {
 
 // 将目标定时器timer添加到链表中
 void sort_timer_srp::add_timer(TimerNode *timer ) {
-    printf("++++++++++++++++++++++++++++++\n");
     if( !timer ) {
         return;
     }
@@ -31,26 +30,28 @@ void sort_timer_srp::adjust_timer(TimerNode *timer)
     if( !timer ){
         return;
     }
-    int idx = ref_[timer];
-    if(idx < 0)return;
-    swifdown_(idx);
+    // 用find查找，operator[]会为不在堆中的定时器插入下标0
+    auto it = ref_.find(timer);
+    if(it == ref_.end())return;
+    swifdown_(it->second);
 }
 
 // 将目标定时器 timer 从链表中删除
 void sort_timer_srp::del_timer( TimerNode* timer )
 {
-    printf("------------------------------\n");
     if( !timer ) {
         return;
     }
-    int idx = ref_[timer];
-    if(idx < 0)return;
+    auto it = ref_.find(timer);
+    if(it == ref_.end())return;
+    int idx = it->second;
     swapnode_(idx, size_);
 
     heap_[size_--] = nullptr;
 
-    if(size_)swifup_(idx);
-    if(size_)swifdown_(idx);
+    // 删除的是最后一个节点时不需要调整
+    if(idx <= size_)swifup_(idx);
+    if(idx <= size_)swifdown_(idx);
 
     ref_.erase(timer);
 
@@ -62,7 +63,6 @@ void sort_timer_srp::tick() {
     if( size_ == 0 ) {
         return;
     }
-    printf( "timer tick\n" );
     time_t cur = time( NULL );  // 获取当前系统时间
     TimerNode* tmp = heap_[1];
     // 从头节点开始依次处理每个定时器，直到遇到一个尚未到期的定时器